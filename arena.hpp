@@ -0,0 +1,41 @@
+/*
+ * arena.hpp - Memory of a single run.
+ *
+ * Everything one invocation allocates (the interface table, the scratch maps and read buffers of the backends, the
+ * rendered output) lives until the process exits, so it is carved out of a monotonic arena instead of being
+ * allocated and freed piece by piece. The arena starts in a buffer on main()'s stack, large enough for typical hosts,
+ * and takes geometrically larger blocks from the heap once that is used up, so that even a host with 10k interfaces
+ * costs only a handful of malloc() calls. Deallocation is a no-op; all of it is released at once with the arena.
+ *
+ * Containers take the memory_resource to use when they are constructed and default to the heap
+ * (std::pmr::get_default_resource()): the long-running modes (daemon, watch) rebuild their tables over and over and
+ * would make a monotonic arena grow forever, and worker threads cannot share one, as it is not thread-safe.
+ */
+
+#ifndef IFACEPICKER_ARENA_HPP
+#define IFACEPICKER_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+
+// Size of the arena's initial buffer, on the stack: a netlink receive buffer plus a few hundred interfaces
+constexpr std::size_t RUN_ARENA_SIZE{128 * 1024};
+
+// Buffer that output is rendered into before being written at once
+using OutputBuffer = std::pmr::string;
+
+class RunArena {
+public:
+    RunArena() = default;
+    RunArena(const RunArena&) = delete;
+    RunArena& operator=(const RunArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &arena; }
+
+private:
+    alignas(std::max_align_t) char initial[RUN_ARENA_SIZE];
+    std::pmr::monotonic_buffer_resource arena{initial, sizeof(initial), std::pmr::new_delete_resource()};
+};
+
+#endif // IFACEPICKER_ARENA_HPP
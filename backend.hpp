@@ -0,0 +1,396 @@
+/*
+ * backend.hpp - Selectable interface enumeration backends.
+ *
+ * Backends, from fastest to slowest:
+ *   snapshot    Read the table a running daemon publishes in shared memory (see snapshot.hpp)
+ *   daemon      Ask a running `ifacepicker --daemon` over its Unix socket (see daemon.hpp)
+ *   netlink     RTM_GETLINK/RTM_GETADDR dumps on a NETLINK_ROUTE socket (see netlink.hpp)
+ *   getifaddrs  The libc getifaddrs() interface
+ *   ioctl       Interface names from /proc/net/dev, addresses from the SIOCGIFCONF ioctl; works where netlink
+ *               sockets are blocked (e.g. by a seccomp profile)
+ *   ip          Parse the output of 'ip -j address show' (see ip_command.hpp)
+ * A table can also come from the cache of an earlier run (Backend::Cache, see table_cache.hpp), which is not a backend
+ * one can ask for.
+ *
+ * With Backend::Auto each one is tried in that order and the first that works is used. Every backend applies the
+ * InterfaceFilter while it enumerates (see filter.hpp); only netlink knows link kinds, so --type requires it (or the
+ * daemon, which enumerates with netlink).
+ */
+
+#ifndef IFACEPICKER_BACKEND_HPP
+#define IFACEPICKER_BACKEND_HPP
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "daemon.hpp"
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "ip_command.hpp"
+#include "netlink.hpp"
+#include "snapshot.hpp"
+#include "timings.hpp"
+
+enum class Backend { Auto, Snapshot, Daemon, Netlink, Getifaddrs, Ioctl, Ip, Cache };
+
+// Backends tried by Backend::Auto, fastest first
+constexpr Backend BACKEND_PREFERENCE[]{Backend::Snapshot, Backend::Daemon, Backend::Netlink, Backend::Getifaddrs,
+                                       Backend::Ioctl, Backend::Ip};
+
+// Function to count the bits set in an IPv4 or IPv6 netmask (nullptr counts as 0)
+inline std::uint8_t prefixLengthOf(const sockaddr* netmask) {
+    if (netmask == nullptr) {
+        return 0;
+    }
+    if (netmask->sa_family == AF_INET) {
+        return static_cast<std::uint8_t>(
+            __builtin_popcount(reinterpret_cast<const sockaddr_in*>(netmask)->sin_addr.s_addr));
+    }
+    if (netmask->sa_family == AF_INET6) {
+        int bits{0};
+        for (std::uint8_t byte : reinterpret_cast<const sockaddr_in6*>(netmask)->sin6_addr.s6_addr) {
+            bits += __builtin_popcount(byte);
+        }
+        return static_cast<std::uint8_t>(bits);
+    }
+    return 0;
+}
+
+// Function to convert the IPV6_ADDR_* scope bits of /proc/net/if_inet6 to the RT_SCOPE_* value used by netlink
+inline std::uint8_t scopeFromInet6Flags(unsigned int scope) {
+    switch (scope & 0xf0) {
+    case 0x10:
+        return RT_SCOPE_HOST;
+    case 0x20:
+        return RT_SCOPE_LINK;
+    case 0x40:
+        return RT_SCOPE_SITE;
+    default:
+        return RT_SCOPE_UNIVERSE;
+    }
+}
+
+// Function to get the command line name of a backend
+inline const char* backendName(Backend backend) {
+    switch (backend) {
+    case Backend::Auto:
+        return "auto";
+    case Backend::Snapshot:
+        return "snapshot";
+    case Backend::Daemon:
+        return "daemon";
+    case Backend::Netlink:
+        return "netlink";
+    case Backend::Getifaddrs:
+        return "getifaddrs";
+    case Backend::Ioctl:
+        return "ioctl";
+    case Backend::Ip:
+        return "ip";
+    case Backend::Cache:
+        return "cache";
+    }
+    return "unknown";
+}
+
+// Function to parse a backend from its command line name; returns false if the name is unknown
+inline bool parseBackend(const std::string& name, Backend& backend) {
+    for (Backend candidate :
+         {Backend::Auto, Backend::Snapshot, Backend::Daemon, Backend::Netlink, Backend::Getifaddrs, Backend::Ioctl,
+          Backend::Ip}) {
+        if (name == backendName(candidate)) {
+            backend = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Fill the interface table using getifaddrs().
+ * The list holds one AF_PACKET entry per interface (so interfaces without addresses are seen too) followed by one
+ * entry per IPv4 and IPv6 address.
+ */
+inline bool enumerateWithGetifaddrs(InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    ifaddrs* addresses{nullptr};
+    TimedPhase openPhase{Phase::Open};
+    if (getifaddrs(&addresses) != 0) {
+        return false;
+    }
+    openPhase.stop();
+    std::unique_ptr<ifaddrs, decltype(&freeifaddrs)> guard(addresses, freeifaddrs);
+
+    // Keys point into the getifaddrs() list, which outlives the map; filtered out interfaces map to SKIPPED
+    constexpr std::size_t SKIPPED{static_cast<std::size_t>(-1)};
+    std::pmr::unordered_map<std::string_view, std::size_t> positionByName{interfaceList.resource()};
+    for (const ifaddrs* entry{addresses}; entry != nullptr; entry = entry->ifa_next) {
+        auto inserted{positionByName.emplace(entry->ifa_name, interfaceList.size())};
+        if (inserted.second) {
+            if (!filter.acceptsFlags(entry->ifa_flags)) {
+                inserted.first->second = SKIPPED;
+            } else {
+                int index{0};
+                if (entry->ifa_addr != nullptr && entry->ifa_addr->sa_family == AF_PACKET) {
+                    index = reinterpret_cast<const sockaddr_ll*>(entry->ifa_addr)->sll_ifindex;
+                }
+                interfaceList.add(entry->ifa_name, index, entry->ifa_flags);
+            }
+        }
+
+        if (entry->ifa_addr == nullptr || inserted.first->second == SKIPPED ||
+            !filter.acceptsFamily(entry->ifa_addr->sa_family)) {
+            continue;
+        }
+        if (entry->ifa_addr->sa_family == AF_INET) {
+            interfaceList.addAddress(inserted.first->second, AF_INET,
+                                     &reinterpret_cast<const sockaddr_in*>(entry->ifa_addr)->sin_addr,
+                                     prefixLengthOf(entry->ifa_netmask));
+        } else if (entry->ifa_addr->sa_family == AF_INET6) {
+            interfaceList.addAddress(inserted.first->second, AF_INET6,
+                                     &reinterpret_cast<const sockaddr_in6*>(entry->ifa_addr)->sin6_addr,
+                                     prefixLengthOf(entry->ifa_netmask));
+        }
+    }
+    interfaceList.finish();
+    return true;
+}
+
+/*
+ * Fill the interface table using ioctl() on an AF_INET datagram socket.
+ * SIOCGIFCONF only reports interfaces that have an IPv4 address, so the complete set of names is read from
+ * /proc/net/dev and ordered by the index returned by SIOCGIFINDEX, as the other backends do. SIOCGIFCONF has no IPv6
+ * support either; IPv6 addresses are read from /proc/net/if_inet6.
+ */
+inline bool enumerateWithIoctl(InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    TimedPhase openPhase{Phase::Open};
+    DescriptorGuard guard{socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+    int fd{guard.fd};
+    if (fd < 0) {
+        return false;
+    }
+
+    std::unique_ptr<FILE, decltype(&fclose)> devices(fopen("/proc/net/dev", "r"), fclose);
+    if (!devices) {
+        return false;
+    }
+    openPhase.stop();
+
+    // Each line after the two header lines starts with "  <name>: <counters>"
+    struct IoctlInterface {
+        int index;
+        unsigned int flags;
+        std::pmr::string name;
+    };
+    std::pmr::vector<IoctlInterface> names{interfaceList.resource()};
+    char line[512];
+    while (fgets(line, sizeof(line), devices.get()) != nullptr) {
+        timings().count(Counter::LinesRead);
+        timings().count(Counter::BytesRead, std::strlen(line));
+        char* colon{std::strchr(line, ':')};
+        if (colon == nullptr) {
+            continue;
+        }
+        *colon = '\0';
+        char* name{line + std::strspn(line, " ")};
+
+        ifreq request{};
+        std::strncpy(request.ifr_name, name, IFNAMSIZ - 1);
+        int index{ioctl(fd, SIOCGIFINDEX, &request) == 0 ? request.ifr_ifindex : 0};
+        unsigned int flags{ioctl(fd, SIOCGIFFLAGS, &request) == 0 ? static_cast<unsigned short>(request.ifr_flags) : 0u};
+        if (filter.acceptsFlags(flags)) {
+            names.push_back(IoctlInterface{index, flags, std::pmr::string{name, interfaceList.resource()}});
+        }
+    }
+    std::sort(names.begin(), names.end(),
+              [](const IoctlInterface& a, const IoctlInterface& b) { return a.index < b.index; });
+
+    // Ask for the required buffer size first (a null ifc_buf makes the kernel report it), then fetch the list
+    ifconf configuration{};
+    if (ioctl(fd, SIOCGIFCONF, &configuration) < 0) {
+        return false;
+    }
+    std::pmr::vector<ifreq> requests(configuration.ifc_len / sizeof(ifreq) + 1, interfaceList.resource());
+    configuration.ifc_len = static_cast<int>(requests.size() * sizeof(ifreq));
+    configuration.ifc_req = requests.data();
+    if (ioctl(fd, SIOCGIFCONF, &configuration) < 0) {
+        return false;
+    }
+    requests.resize(configuration.ifc_len / sizeof(ifreq));
+
+    // Keys point into `names`, which is not modified any more
+    std::pmr::unordered_map<std::string_view, std::size_t> positionByName{interfaceList.resource()};
+    interfaceList.reserve(names.size());
+    for (const auto& entry : names) {
+        positionByName.emplace(entry.name, interfaceList.size());
+        interfaceList.add(entry.name, entry.index, entry.flags);
+    }
+
+    for (ifreq& request : requests) {
+        if (request.ifr_addr.sa_family != AF_INET || !filter.acceptsFamily(AF_INET)) {
+            continue;
+        }
+
+        // Secondary addresses are reported under alias labels such as "eth0:1"
+        std::string_view name{request.ifr_name, strnlen(request.ifr_name, IFNAMSIZ)};
+        auto position{positionByName.find(name.substr(0, name.find(':')))};
+        if (position == positionByName.end()) {
+            continue;
+        }
+
+        // SIOCGIFCONF does not report netmasks; a failure here just leaves the prefix length at 0
+        in_addr address{reinterpret_cast<const sockaddr_in*>(&request.ifr_addr)->sin_addr};
+        std::uint8_t prefixLength{0};
+        if (ioctl(fd, SIOCGIFNETMASK, &request) == 0) {
+            prefixLength = prefixLengthOf(&request.ifr_netmask);
+        }
+        interfaceList.addAddress(position->second, AF_INET, &address, prefixLength);
+    }
+
+    // Each line is "<address as 32 hex digits> <ifindex> <prefix length> <scope> <flags> <name>", all hex
+    std::unique_ptr<FILE, decltype(&fclose)> inet6(
+        filter.acceptsFamily(AF_INET6) ? fopen("/proc/net/if_inet6", "r") : nullptr, fclose);
+    while (inet6 && fgets(line, sizeof(line), inet6.get()) != nullptr) {
+        timings().count(Counter::LinesRead);
+        timings().count(Counter::BytesRead, std::strlen(line));
+        char hex[33];
+        unsigned int index, prefixLength, scope, flags;
+        char name[IFNAMSIZ + 1];
+        if (std::sscanf(line, "%32s %x %x %x %x %16s", hex, &index, &prefixLength, &scope, &flags, name) != 6) {
+            continue;
+        }
+
+        in6_addr address;
+        for (int i = 0; i < 16; ++i) {
+            char byte[3]{hex[2 * i], hex[2 * i + 1], '\0'};
+            address.s6_addr[i] = static_cast<std::uint8_t>(std::strtoul(byte, nullptr, 16));
+        }
+
+        auto position{positionByName.find(name)};
+        if (position != positionByName.end()) {
+            interfaceList.addAddress(position->second, AF_INET6, &address, static_cast<std::uint8_t>(prefixLength),
+                                     scopeFromInet6Flags(scope));
+        }
+    }
+
+    interfaceList.finish();
+    return true;
+}
+
+// Function to check whether a backend can apply a filter; link types (kinds) are only reported by netlink
+inline bool backendSupports(Backend backend, const InterfaceFilter& filter) {
+    return !filter.hasLinkType() || backend == Backend::Netlink || backend == Backend::Daemon ||
+           backend == Backend::Auto;
+}
+
+// Function to fill the interface list with one specific backend
+inline bool enumerateWith(Backend backend, InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    if (!backendSupports(backend, filter)) {
+        return false;
+    }
+
+    switch (backend) {
+    case Backend::Snapshot:
+        return readSnapshot(interfaceList, filter);
+    case Backend::Daemon:
+        return queryDaemon(interfaceList, filter);
+    case Backend::Netlink:
+        return enumerateWithNetlink(interfaceList, filter);
+    case Backend::Getifaddrs:
+        return enumerateWithGetifaddrs(interfaceList, filter);
+    case Backend::Ioctl:
+        return enumerateWithIoctl(interfaceList, filter);
+    case Backend::Ip:
+        return enumerateWithIpCommand(interfaceList, filter);
+    case Backend::Auto:
+    case Backend::Cache:
+        break;
+    }
+    return false;
+}
+
+/*
+ * Fill the interface list with the requested backend.
+ * For Backend::Auto the backends are tried fastest first; a backend that fails (e.g. because its socket type is
+ * blocked in this sandbox) leaves no partial results behind. On success, `used` tells which backend answered.
+ */
+inline bool enumerateInterfaces(Backend backend, InterfaceTable& interfaceList, const InterfaceFilter& filter,
+                                Backend& used) {
+    if (backend != Backend::Auto) {
+        used = backend;
+        return enumerateWith(backend, interfaceList, filter);
+    }
+
+    for (Backend candidate : BACKEND_PREFERENCE) {
+        if (enumerateWith(candidate, interfaceList, filter)) {
+            used = candidate;
+            return true;
+        }
+        interfaceList.clear();
+    }
+    return false;
+}
+
+/*
+ * Fill the interface table with just the interface called `name` (or nothing if there is none).
+ * The daemon and netlink answer this with a lookup whose cost does not depend on the number of interfaces; the other
+ * backends can only enumerate everything and keep the one that matches.
+ */
+inline bool enumerateInterface(Backend backend, const std::string& name, InterfaceTable& interfaceList,
+                               const InterfaceFilter& filter, Backend& used) {
+    if ((backend == Backend::Auto || backend == Backend::Snapshot) && !filter.hasLinkType()) {
+        if (readSnapshot(interfaceList, filter, name.c_str())) {
+            used = Backend::Snapshot;
+            return true;
+        }
+        interfaceList.clear();
+        if (backend == Backend::Snapshot) {
+            used = backend;
+            return false;
+        }
+    }
+    if (backend == Backend::Auto || backend == Backend::Daemon) {
+        if (queryDaemon(interfaceList, filter, name.c_str())) {
+            used = Backend::Daemon;
+            return true;
+        }
+        interfaceList.clear();
+        if (backend == Backend::Daemon) {
+            used = backend;
+            return false;
+        }
+    }
+    if (backend == Backend::Auto || backend == Backend::Netlink) {
+        if (enumerateOneWithNetlink(interfaceList, name.c_str(), filter)) {
+            used = Backend::Netlink;
+            return true;
+        }
+        interfaceList.clear();
+        if (backend == Backend::Netlink) {
+            used = backend;
+            return false;
+        }
+    }
+    return enumerateInterfaces(backend, interfaceList, filter, used);
+}
+
+#endif // IFACEPICKER_BACKEND_HPP
@@ -0,0 +1,184 @@
+/*
+ * batch.hpp - Answer many selectors from a single enumeration.
+ *
+ * `ifacepicker --batch SELECTOR...` (or one selector per line on stdin when none is given) enumerates the interfaces
+ * once and prints one result block per selector, in the order given. Selectors are parsed by parseBatchSelector():
+ *   eth0        An interface name
+ *   'vlan*'     A shell glob: the first matching interface
+ *   3           A position in the list
+ *   10.1.2.3    A route destination: the interface the kernel would use to reach it (one RTM_GETROUTE each), shown
+ *               with the route's preferred source address as with --route-to
+ *   10.1.2.3/32 An owned address: the interface configured with it, or on the longest network containing it (as
+ *               --owner-of)
+ * Result blocks, per --format (text and env are the same):
+ *   env   SELECTOR=<selector>, IFACE= and IPADDR= lines, blocks separated by empty lines
+ *   json  An array of {"selector": ..., "interface": <object as for a single interface, or null>}
+ *   tsv   <selector>TAB<name>TAB<address> lines
+ *   nul   <selector>NUL<name>NUL<address>NUL
+ * With --fields, the fields of the template take the place of the name and address (see fields.hpp).
+ * A selector that matches nothing gets empty fields (null in JSON) and makes the exit status 1. The table is indexed
+ * (see table_index.hpp) on the first lookup that needs it, so the cost of a batch grows with the number of selectors,
+ * not with selectors times interfaces.
+ */
+
+#ifndef IFACEPICKER_BATCH_HPP
+#define IFACEPICKER_BATCH_HPP
+
+#include <arpa/inet.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "console.hpp"
+#include "fields.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "netlink.hpp"
+#include "output.hpp"
+#include "selector.hpp"
+
+// Function to read batch selectors from a descriptor, one per line; empty lines and lines starting with '#' are skipped
+inline void readBatchSelectors(int fd, std::vector<std::string>& selectors) {
+    std::string text;
+    readAll(fd, text);
+    std::string_view rest{text};
+    while (!rest.empty()) {
+        std::size_t end{rest.find('\n')};
+        std::string_view line{rest.substr(0, end)};
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        std::size_t first{line.find_first_not_of(" \t\r")};
+        if (first == std::string_view::npos || line[first] == '#') {
+            continue;
+        }
+        std::size_t last{line.find_last_not_of(" \t\r")};
+        selectors.emplace_back(line.substr(first, last - first + 1));
+    }
+}
+
+/*
+ * Resolve the route selectors of a batch to interface indexes and preferred source addresses (of the filter's family
+ * only), over a single netlink socket. An unreachable destination matches nothing; returns false, with an error
+ * message, if the routes cannot be looked up at all.
+ */
+inline bool resolveRouteSelectors(std::vector<InterfaceSelector>& selectors, const InterfaceFilter& filter) {
+    NetlinkSocket socket;
+    bool opened{false};
+    for (InterfaceSelector& selector : selectors) {
+        if (selector.kind != InterfaceSelector::Kind::Route) {
+            continue;
+        }
+        if (!opened && !socket.open()) {
+            errorMessage() << "Error opening a netlink socket for route lookups: " << std::strerror(errno) << '\n';
+            return false;
+        }
+        opened = true;
+
+        in6_addr destination;
+        int family{inet_pton(AF_INET, selector.value.c_str(), &destination) == 1 ? AF_INET : AF_INET6};
+        inet_pton(family, selector.value.c_str(), &destination);
+        RouteLookup route;
+        if (!lookupRouteWithNetlink(socket, family, &destination, route)) {
+            int error{socket.error()};
+            if (error != 0 && error != ENETUNREACH && error != EHOSTUNREACH) {
+                errorMessage() << "Error looking up the route to " << selector.value << ": " << std::strerror(error)
+                               << '\n';
+                return false;
+            }
+            continue;
+        }
+        selector.index = route.index;
+        selector.hasSource = route.hasSource && filter.acceptsFamily(family);
+        selector.source = route.source;
+        selector.source.prefixLength = static_cast<std::uint8_t>(family == AF_INET6 ? 128 : 32);
+    }
+    return true;
+}
+
+// Function to append one result block per selector in a format; returns false if a selector matched nothing
+template <typename Format>
+inline bool appendBatchResults(OutputBuffer& out, const InterfaceTable& interfaceList,
+                               const std::vector<InterfaceSelector>& selectors, const AddressSelector& addressSelector,
+                               const AddressSelector& routeAddressSelector, FieldTemplate* fields) {
+    bool templated{fields != nullptr && !fields->empty()};
+    bool allFound{true};
+    InterfaceIndex index{interfaceList};
+    out += Format::LIST_START;
+    for (std::size_t i = 0; i < selectors.size(); ++i) {
+        const InterfaceSelector& selector{selectors[i]};
+        std::size_t position{findInterface(interfaceList, selector, &index)};
+        allFound = allFound && position != NO_INTERFACE;
+
+        // A route selector shows the route's preferred source, if any, rather than the interface's addresses
+        AddressRange routeSource{&selector.source, &selector.source + (selector.hasSource ? 1 : 0)};
+        AddressSelector routeSelector{routeAddressSelector};
+        routeSelector.addresses = &routeSource;
+        const AddressSelector& selected{selector.kind == InterfaceSelector::Kind::Route ? routeSelector
+                                                                                        : addressSelector};
+        if (i > 0) {
+            out += Format::LIST_SEPARATOR;
+        }
+
+        if constexpr (Format::FORMAT == OutputFormat::Json) {
+            out += "{\"selector\":";
+            appendJsonString(out, selector.value);
+            out += ",\"interface\":";
+            if (position != NO_INTERFACE) {
+                appendInterface<Format>(out, interfaceList, interfaceList[position], selected, {}, fields);
+            } else {
+                out += "null";
+            }
+            out += '}';
+        } else if constexpr (Format::FORMAT == OutputFormat::Tsv || Format::FORMAT == OutputFormat::Nul) {
+            out += selector.value;
+            out += Format::SEPARATOR;
+            if (position != NO_INTERFACE) {
+                appendInterface<Format>(out, interfaceList, interfaceList[position], selected, {}, fields);
+            } else {
+                // One empty column per field
+                for (std::size_t field = 1; field < (templated ? fields->fields().size() : 2); ++field) {
+                    out += Format::SEPARATOR;
+                }
+                out += Format::TERMINATOR;
+            }
+        } else {
+            out += "SELECTOR=";
+            out += selector.value;
+            out += '\n';
+            if (position != NO_INTERFACE) {
+                appendInterface<Format>(out, interfaceList, interfaceList[position], selected, {}, fields);
+            } else if (templated) {
+                for (Field field : fields->fields()) {
+                    out += fieldNames(field).envKey;
+                    out += "=\n";
+                }
+            } else {
+                out += "IFACE=\nIPADDR=\n";
+            }
+        }
+    }
+    out += Format::LIST_END;
+    return allFound;
+}
+
+/*
+ * Append one result block per selector to `out`, with the fields of the template if one is given (see fields.hpp).
+ * Returns false if at least one selector matched no interface.
+ */
+inline bool appendBatchResults(OutputBuffer& out, OutputFormat format, const InterfaceTable& interfaceList,
+                               const std::vector<InterfaceSelector>& selectors, const AddressSelector& addressSelector,
+                               const AddressSelector& routeAddressSelector, FieldTemplate* fields = nullptr) {
+    bool allFound{true};
+    withFormat(format == OutputFormat::Text ? OutputFormat::Env : format, [&](auto policy) {
+        using Format = decltype(policy);
+        if constexpr (Format::FORMAT != OutputFormat::Text) {
+            allFound = appendBatchResults<Format>(out, interfaceList, selectors, addressSelector, routeAddressSelector,
+                                                  fields);
+        }
+    });
+    return allFound;
+}
+
+#endif // IFACEPICKER_BATCH_HPP
@@ -0,0 +1,605 @@
+/*
+ * ifacepicker-bench - Throughput, allocations and memory of the interface parsers at scale.
+ * Built and run by `make bench`.
+ *
+ * Synthetic corpora are generated for each size given on the command line (default: 10, 1000, 10000 and 100000
+ * interfaces) and parsed by each parser variant:
+ *   ip       'ip -j address show' output, read from a file with ChunkedJsonReader and parsed by parseIpCommandObject()
+ *   netlink  RTM_NEWLINK/RTM_NEWADDR dumps split into NETLINK_BUFFER_SIZE datagrams, decoded by NetlinkTableBuilder
+ *   image    The binary table image of the daemon, the snapshot and fleet mode, loaded by InterfaceTable::loadImage()
+ * The interfaces come in several shapes, so that the corpora contain interfaces without any address, interfaces with
+ * many inet6 addresses, veth peers and long aliases (including one larger than the read chunk). The
+ * backends that read the host (netlink, getifaddrs, ioctl, ip, and the daemon and snapshot when one is running) are
+ * measured as well, on whatever interfaces the host has.
+ *
+ * Every measurement runs in its own child process so that its peak RSS is its own. One line is printed per
+ * measurement: the average throughput over repeated parses (for at least BENCH_MINIMUM_NS), the allocations per
+ * parse, the peak RSS of the child while parsing (VmHWM, reset once the corpus is generated) and how much of it the
+ * parses added over the resident corpus. A parse that does
+ * not produce the expected table makes the exit status 1.
+ *
+ * Last, the startup cost of a one-shot run is measured on both builds, ./ifacepicker and the static ./ifacepicker-static
+ * (`make static`): each is spawned with BENCH_EXEC_ARGUMENTS repeatedly, and the time from posix_spawn() to the end
+ * of waitpid() is reported, as a script calling ifacepicker would see it.
+ *
+ * Compilation: g++ -O2 bench.cpp -o ifacepicker-bench -pthread
+ */
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "backend.hpp"
+#include "timings.hpp"
+
+// Every allocation of the program goes through these, so that the allocations of each parse can be counted
+void* operator new(std::size_t size) {
+    timings().count(Counter::Allocations);
+    timings().count(Counter::AllocatedBytes, size);
+    if (void* pointer{std::malloc(size != 0 ? size : 1)}) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+// Not inlined: GCC would otherwise see free() applied to the result of operator new and warn about a mismatch
+__attribute__((noinline)) void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+// Over-aligned allocations, such as the heap blocks of the arena (see arena.hpp)
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    timings().count(Counter::Allocations);
+    timings().count(Counter::AllocatedBytes, size);
+    auto boundary{static_cast<std::size_t>(alignment)};
+    if (void* pointer{std::aligned_alloc(boundary, (size + boundary - 1) / boundary * boundary)}) {
+        return pointer;
+    }
+    throw std::bad_alloc{};
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
+// Sizes of the synthetic corpora, in interfaces
+constexpr std::size_t BENCH_SIZES[]{10, 1000, 10000, 100000};
+
+// Each measurement repeats its parse for at least this long (and at least BENCH_MINIMUM_RUNS times)
+constexpr std::int64_t BENCH_MINIMUM_NS{250000000};
+constexpr int BENCH_MINIMUM_RUNS{3};
+
+// The builds whose exec-to-exit time is measured, and the one-shot query they run
+constexpr const char* BENCH_EXEC_PROGRAMS[]{"./ifacepicker", "./ifacepicker-static"};
+constexpr const char* BENCH_EXEC_ARGUMENTS[]{"--backend=netlink", "--iface", "lo"};
+
+// An interface object larger than the chunk ChunkedJsonReader reads at once, so that its buffer has to grow
+constexpr std::size_t BENCH_HUGE_OBJECT{2 * IP_COMMAND_CHUNK_SIZE};
+
+// Length of the alias of LongLine interfaces; IFALIASZ - 1 is the most the kernel stores
+constexpr std::size_t BENCH_ALIAS_LENGTH{255};
+
+// Number of inet6 addresses of ManyInet6 interfaces
+constexpr unsigned int BENCH_MANY_INET6{16};
+
+/*
+ * What a synthetic interface looks like:
+ * - NoAddress: Down, without any address.
+ * - ManyInet6: An IPv4 address and BENCH_MANY_INET6 global IPv6 addresses.
+ * - LongLine: A long alias (the first one of a corpus is larger than the read chunk), an IPv4 and an IPv6 address.
+ * - Peer: A veth with a peer link index, with only a link-local IPv6 address.
+ * - Plain: An IPv4 and an IPv6 address.
+ */
+enum class Shape { NoAddress, ManyInet6, LongLine, Peer, Plain };
+
+// Function to pick the shape of the i-th synthetic interface
+inline Shape shapeOf(std::size_t i) {
+    switch (i % 8) {
+    case 0:
+        return Shape::NoAddress;
+    case 1:
+        return Shape::ManyInet6;
+    case 2:
+        return Shape::LongLine;
+    case 3:
+        return Shape::Peer;
+    default:
+        return Shape::Plain;
+    }
+}
+
+// Function to count the addresses of the first `count` synthetic interfaces
+inline std::size_t syntheticAddressCount(std::size_t count) {
+    std::size_t total{0};
+    for (std::size_t i = 0; i < count; ++i) {
+        switch (shapeOf(i)) {
+        case Shape::NoAddress:
+            break;
+        case Shape::ManyInet6:
+            total += 1 + BENCH_MANY_INET6;
+            break;
+        case Shape::Peer:
+            total += 1;
+            break;
+        case Shape::LongLine:
+        case Shape::Plain:
+            total += 2;
+            break;
+        }
+    }
+    return total;
+}
+
+// Function to format the name of the i-th synthetic interface
+inline std::string syntheticName(std::size_t i) {
+    return (shapeOf(i) == Shape::Peer ? "veth" : "eth") + std::to_string(i);
+}
+
+// The IPv4 address of the i-th synthetic interface, in host byte order
+inline std::uint32_t syntheticInet(std::size_t i) { return (10u << 24) | static_cast<std::uint32_t>(i + 1); }
+
+// The k-th IPv6 address of the i-th synthetic interface
+inline in6_addr syntheticInet6(std::size_t i, unsigned int k, bool linkLocal) {
+    in6_addr address{};
+    address.s6_addr[0] = linkLocal ? 0xfe : 0xfd;
+    address.s6_addr[1] = linkLocal ? 0x80 : 0x00;
+    for (int byte = 0; byte < 4; ++byte) {
+        address.s6_addr[11 - byte] = static_cast<std::uint8_t>((i + 1) >> (8 * byte));
+    }
+    address.s6_addr[15] = static_cast<std::uint8_t>(k + 1);
+    return address;
+}
+
+// Function to generate the output of 'ip -j address show' for `count` interfaces
+inline std::string generateIpCommandJson(std::size_t count) {
+    std::string text{"["};
+    char member[256];
+    char address[ADDRESS_TEXT_SIZE];
+    auto appendAddress{[&](bool first, int family, const void* value, unsigned int prefixLength, const char* scope,
+                           const std::string& label) {
+        inet_ntop(family, value, address, sizeof(address));
+        std::snprintf(member, sizeof(member), "%s{\"family\":\"%s\",\"local\":\"%s\",\"prefixlen\":%u,", first ? "" : ",",
+                      family == AF_INET ? "inet" : "inet6", address, prefixLength);
+        text += member;
+        if (family == AF_INET) {
+            text += "\"broadcast\":\"10.255.255.255\",";
+        }
+        std::snprintf(member, sizeof(member), "\"scope\":\"%s\",", scope);
+        text += member;
+        if (!label.empty()) {
+            text += "\"label\":\"" + label + "\",";
+        }
+        text += "\"valid_life_time\":4294967295,\"preferred_life_time\":4294967295}";
+    }};
+
+    bool hugeLineWritten{false};
+    for (std::size_t i = 0; i < count; ++i) {
+        Shape shape{shapeOf(i)};
+        std::string name{syntheticName(i)};
+        std::snprintf(member, sizeof(member), "%s{\"ifindex\":%zu,", i == 0 ? "" : ",", i + 1);
+        text += member;
+        if (shape == Shape::Peer) {
+            std::snprintf(member, sizeof(member), "\"link_index\":%zu,", i + 2);
+            text += member;
+        }
+        text += "\"ifname\":\"" + name + "\",";
+        text += shape == Shape::NoAddress ? "\"flags\":[\"BROADCAST\",\"MULTICAST\"],"
+                                          : "\"flags\":[\"BROADCAST\",\"MULTICAST\",\"UP\",\"LOWER_UP\"],";
+        std::snprintf(member, sizeof(member),
+                      "\"mtu\":1500,\"qdisc\":\"mq\",\"operstate\":\"%s\",\"group\":\"default\",\"txqlen\":1000,"
+                      "\"link_type\":\"ether\",\"address\":\"02:00:%02zx:%02zx:%02zx:%02zx\",\"broadcast\":\"ff:ff:ff:ff:ff:ff\",",
+                      shape == Shape::NoAddress ? "DOWN" : "UP", (i >> 24) & 0xff, (i >> 16) & 0xff, (i >> 8) & 0xff,
+                      i & 0xff);
+        text += member;
+        if (shape == Shape::LongLine) {
+            text += "\"ifalias\":\"";
+            text.append(hugeLineWritten ? BENCH_ALIAS_LENGTH : BENCH_HUGE_OBJECT, 'a');
+            text += "\",";
+            hugeLineWritten = true;
+        }
+        text += "\"addr_info\":[";
+        bool first{true};
+        if (shape != Shape::NoAddress && shape != Shape::Peer) {
+            in_addr inet{htonl(syntheticInet(i))};
+            appendAddress(first, AF_INET, &inet, 8, "global", name);
+            first = false;
+        }
+        unsigned int inet6Count{shape == Shape::NoAddress ? 0u : shape == Shape::ManyInet6 ? BENCH_MANY_INET6 : 1u};
+        for (unsigned int k = 0; k < inet6Count; ++k) {
+            in6_addr inet6{syntheticInet6(i, k, shape == Shape::Peer)};
+            appendAddress(first, AF_INET6, &inet6, 64, shape == Shape::Peer ? "link" : "global", {});
+            first = false;
+        }
+        text += "]}";
+    }
+    text += "]\n";
+    return text;
+}
+
+/*
+ * Netlink dump replies under construction: messages are appended to the last datagram until it would exceed
+ * NETLINK_BUFFER_SIZE, as the kernel fills the buffer of each recv() of a dump.
+ */
+struct SyntheticDump {
+    std::vector<std::vector<char>> datagrams;
+    std::size_t bytes{0};
+
+    // Start a message with its fixed payload; attributes are then added with attribute()
+    nlmsghdr* begin(std::uint16_t type, const void* payload, std::size_t payloadLength) {
+        alignas(NLMSG_ALIGNTO) static char message[1024];
+        std::memset(message, 0, sizeof(message));
+        auto* header{reinterpret_cast<nlmsghdr*>(message)};
+        header->nlmsg_len = NLMSG_LENGTH(payloadLength);
+        header->nlmsg_type = type;
+        header->nlmsg_flags = NLM_F_MULTI;
+        header->nlmsg_seq = 1;
+        std::memcpy(NLMSG_DATA(header), payload, payloadLength);
+        return header;
+    }
+
+    void attribute(nlmsghdr* header, std::uint16_t type, const void* value, std::size_t length) {
+        auto* attribute{reinterpret_cast<rtattr*>(reinterpret_cast<char*>(header) + NLMSG_ALIGN(header->nlmsg_len))};
+        attribute->rta_type = type;
+        attribute->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+        std::memcpy(RTA_DATA(attribute), value, length);
+        header->nlmsg_len = NLMSG_ALIGN(header->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+    }
+
+    void end(const nlmsghdr* header) {
+        std::size_t length{NLMSG_ALIGN(header->nlmsg_len)};
+        if (datagrams.empty() || datagrams.back().size() + length > NETLINK_BUFFER_SIZE) {
+            datagrams.emplace_back().reserve(NETLINK_BUFFER_SIZE);
+        }
+        const char* data{reinterpret_cast<const char*>(header)};
+        datagrams.back().insert(datagrams.back().end(), data, data + length);
+        bytes += length;
+    }
+};
+
+// Function to generate the RTM_GETLINK and RTM_GETADDR dumps of `count` interfaces (links, IPv4, then IPv6 addresses)
+inline void generateNetlinkDumps(std::size_t count, SyntheticDump& links, SyntheticDump& addresses) {
+    std::string alias(BENCH_ALIAS_LENGTH, 'a');
+    for (std::size_t i = 0; i < count; ++i) {
+        Shape shape{shapeOf(i)};
+        ifinfomsg info{};
+        info.ifi_family = AF_UNSPEC;
+        info.ifi_type = ARPHRD_ETHER;
+        info.ifi_index = static_cast<int>(i + 1);
+        info.ifi_flags = IFF_BROADCAST | IFF_MULTICAST | (shape == Shape::NoAddress ? 0 : IFF_UP | IFF_RUNNING | IFF_LOWER_UP);
+        nlmsghdr* message{links.begin(RTM_NEWLINK, &info, sizeof(info))};
+        std::string name{syntheticName(i)};
+        links.attribute(message, IFLA_IFNAME, name.c_str(), name.size() + 1);
+        std::uint32_t mtu{1500};
+        links.attribute(message, IFLA_MTU, &mtu, sizeof(mtu));
+        unsigned char hardware[6]{0x02, 0x00, static_cast<unsigned char>(i >> 24), static_cast<unsigned char>(i >> 16),
+                                  static_cast<unsigned char>(i >> 8), static_cast<unsigned char>(i)};
+        links.attribute(message, IFLA_ADDRESS, hardware, sizeof(hardware));
+        if (shape == Shape::LongLine) {
+            links.attribute(message, IFLA_IFALIAS, alias.c_str(), alias.size() + 1);
+        }
+        links.end(message);
+    }
+
+    auto addAddress{[&](std::size_t i, int family, const void* value, std::size_t length, unsigned char prefixLength,
+                        unsigned char scope) {
+        ifaddrmsg info{};
+        info.ifa_family = static_cast<unsigned char>(family);
+        info.ifa_prefixlen = prefixLength;
+        info.ifa_scope = scope;
+        info.ifa_index = static_cast<unsigned int>(i + 1);
+        nlmsghdr* message{addresses.begin(RTM_NEWADDR, &info, sizeof(info))};
+        addresses.attribute(message, IFA_ADDRESS, value, length);
+        if (family == AF_INET) {
+            addresses.attribute(message, IFA_LOCAL, value, length);
+        }
+        ifa_cacheinfo cache{};
+        addresses.attribute(message, IFA_CACHEINFO, &cache, sizeof(cache));
+        addresses.end(message);
+    }};
+    for (std::size_t i = 0; i < count; ++i) {
+        Shape shape{shapeOf(i)};
+        if (shape != Shape::NoAddress && shape != Shape::Peer) {
+            in_addr inet{htonl(syntheticInet(i))};
+            addAddress(i, AF_INET, &inet, sizeof(inet), 8, RT_SCOPE_UNIVERSE);
+        }
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        Shape shape{shapeOf(i)};
+        unsigned int inet6Count{shape == Shape::NoAddress ? 0u : shape == Shape::ManyInet6 ? BENCH_MANY_INET6 : 1u};
+        for (unsigned int k = 0; k < inet6Count; ++k) {
+            in6_addr inet6{syntheticInet6(i, k, shape == Shape::Peer)};
+            addAddress(i, AF_INET6, &inet6, sizeof(inet6), 64, shape == Shape::Peer ? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE);
+        }
+    }
+}
+
+// Function to decode dump datagrams the way NetlinkSocket::receive() does, calling handler(const nlmsghdr*)
+template <typename Handler>
+void decodeDump(const SyntheticDump& dump, Handler&& handler) {
+    for (const std::vector<char>& datagram : dump.datagrams) {
+        timings().count(Counter::BytesRead, datagram.size());
+        auto remaining{static_cast<unsigned int>(datagram.size())};
+        for (auto* message{reinterpret_cast<const nlmsghdr*>(datagram.data())}; NLMSG_OK(message, remaining);
+             message = NLMSG_NEXT(message, remaining)) {
+            timings().count(Counter::MessagesRead);
+            handler(message);
+        }
+    }
+}
+
+// Function to read a "Vm...:  N kB" line of /proc/self/status, in KiB (-1 if unavailable)
+inline long residentKilobytes(const char* key) {
+    std::unique_ptr<FILE, decltype(&fclose)> status(fopen("/proc/self/status", "r"), fclose);
+    char line[256];
+    std::size_t length{std::strlen(key)};
+    while (status && fgets(line, sizeof(line), status.get()) != nullptr) {
+        if (std::strncmp(line, key, length) == 0 && line[length] == ':') {
+            return std::strtol(line + length + 1, nullptr, 10);
+        }
+    }
+    return -1;
+}
+
+// Function to make the peak RSS (VmHWM) restart from the current RSS, so that generating the corpus is not counted
+inline void resetPeakResident() {
+    std::unique_ptr<FILE, decltype(&fclose)> clearRefs(fopen("/proc/self/clear_refs", "w"), fclose);
+    if (clearRefs) {
+        std::fputs("5", clearRefs.get());
+    }
+}
+
+/*
+ * What is expected of each parse, and what the corpus costs.
+ * - interfaces / addresses: The table each parse must produce; 0 interfaces accepts any non-empty table (host).
+ * - inputBytes: Size of the input of one parse, or 0 to use the bytes the parse itself reported reading.
+ */
+struct BenchCase {
+    const char* variant;
+    std::size_t interfaces;
+    std::size_t addresses;
+    std::size_t inputBytes;
+};
+
+/*
+ * Run a parse repeatedly into a fresh table, allocated from a fresh arena, and print one result line.
+ * - parse: Called as parse(InterfaceTable&); returns false on failure.
+ * Returns false if a parse failed or produced another table than expected.
+ */
+template <typename Parse>
+bool measure(const BenchCase& benchCase, Parse&& parse) {
+    resetPeakResident();
+    long corpusResident{residentKilobytes("VmRSS")};
+    std::uint64_t allocations0{timings().value(Counter::Allocations)};
+    std::uint64_t allocatedBytes0{timings().value(Counter::AllocatedBytes)};
+    std::uint64_t bytesRead0{timings().value(Counter::BytesRead)};
+
+    int runs{0};
+    std::int64_t elapsed{0};
+    std::size_t interfaces{0};
+    std::size_t addresses{0};
+    while (runs < BENCH_MINIMUM_RUNS || elapsed < BENCH_MINIMUM_NS) {
+        // Each parse gets its own arena, as a run of ifacepicker does
+        RunArena arena;
+        InterfaceTable interfaceList{arena.resource()};
+        std::int64_t start{monotonicNanoseconds()};
+        bool parsed{parse(interfaceList)};
+        elapsed += monotonicNanoseconds() - start;
+        ++runs;
+
+        interfaces = interfaceList.size();
+        addresses = interfaceList.addressTotal();
+        bool expected{benchCase.interfaces == 0 ? interfaces > 0
+                                                : interfaces == benchCase.interfaces &&
+                                                      addresses == benchCase.addresses};
+        if (!parsed || !expected) {
+            std::printf("%-16s %10zu  FAILED (%zu interfaces, %zu addresses)\n", benchCase.variant, benchCase.interfaces,
+                        interfaces, addresses);
+            return false;
+        }
+    }
+
+    double inputBytes{benchCase.inputBytes != 0
+                          ? static_cast<double>(benchCase.inputBytes)
+                          : static_cast<double>(timings().value(Counter::BytesRead) - bytesRead0) / runs};
+    double seconds{static_cast<double>(elapsed) / 1e9};
+    long peakResident{residentKilobytes("VmHWM")};
+    std::printf("%-16s %10zu %10zu %12.0f %8d %10.1f %12.0f %10.1f %12.1f %10ld %10ld\n", benchCase.variant, interfaces,
+                addresses, inputBytes, runs, inputBytes * runs / seconds / 1e6,
+                static_cast<double>(interfaces) * runs / seconds,
+                static_cast<double>(timings().value(Counter::Allocations) - allocations0) / runs,
+                static_cast<double>(timings().value(Counter::AllocatedBytes) - allocatedBytes0) / runs / 1024,
+                peakResident, peakResident - corpusResident);
+    return true;
+}
+
+// Function to parse 'ip -j address show' output for `count` synthetic interfaces, read from a temporary file
+inline bool benchIpCommand(std::size_t count) {
+    std::string text{generateIpCommandJson(count)};
+    std::unique_ptr<FILE, decltype(&fclose)> file(tmpfile(), fclose);
+    if (!file || std::fwrite(text.data(), 1, text.size(), file.get()) != text.size() || std::fflush(file.get()) != 0) {
+        std::perror("tmpfile");
+        return false;
+    }
+    int fd{fileno(file.get())};
+    std::size_t size{text.size()};
+    std::string().swap(text);
+
+    InterfaceFilter filter;
+    return measure(BenchCase{"ip", count, syntheticAddressCount(count), size}, [&](InterfaceTable& interfaceList) {
+        lseek(fd, 0, SEEK_SET);
+        ChunkedJsonReader reader{fd, interfaceList.resource()};
+        IpCommandListBuilder builder{interfaceList, filter};
+        std::string_view object;
+        bool parsed{true};
+        while (parsed && reader.next(object)) {
+            parsed = parseIpCommandObject(object, builder);
+        }
+        interfaceList.finish();
+        return parsed && !reader.failed();
+    });
+}
+
+// Function to decode synthetic netlink dumps of `count` interfaces
+inline bool benchNetlink(std::size_t count) {
+    SyntheticDump links;
+    SyntheticDump addresses;
+    generateNetlinkDumps(count, links, addresses);
+
+    InterfaceFilter filter;
+    return measure(BenchCase{"netlink", count, syntheticAddressCount(count), links.bytes + addresses.bytes},
+                   [&](InterfaceTable& interfaceList) {
+                       NetlinkTableBuilder builder{interfaceList, filter};
+                       decodeDump(links, [&](const nlmsghdr* message) { builder.link(message); });
+                       decodeDump(addresses, [&](const nlmsghdr* message) { builder.address(message); });
+                       builder.finish();
+                       return true;
+                   });
+}
+
+// Function to load the binary image of a table of `count` synthetic interfaces
+inline bool benchImage(std::size_t count) {
+    InterfaceTable source;
+    {
+        SyntheticDump links;
+        SyntheticDump addresses;
+        generateNetlinkDumps(count, links, addresses);
+        InterfaceFilter filter;
+        NetlinkTableBuilder builder{source, filter};
+        decodeDump(links, [&](const nlmsghdr* message) { builder.link(message); });
+        decodeDump(addresses, [&](const nlmsghdr* message) { builder.address(message); });
+        builder.finish();
+    }
+    OutputBuffer image;
+    source.appendImage(image);
+
+    return measure(BenchCase{"image", count, syntheticAddressCount(count), image.size()},
+                   [&](InterfaceTable& interfaceList) { return interfaceList.loadImage(image.data(), image.size()); });
+}
+
+// Function to enumerate the interfaces of the host with one backend; false if the backend is unavailable here
+inline bool benchHostBackend(Backend backend) {
+    std::string variant{std::string{"host:"} + backendName(backend)};
+    InterfaceFilter filter;
+    InterfaceTable probe;
+    if (!enumerateWith(backend, probe, filter) || probe.empty()) {
+        std::printf("%-16s %10s  unavailable\n", variant.c_str(), "-");
+        return true;
+    }
+    return measure(BenchCase{variant.c_str(), 0, 0, 0},
+                   [&](InterfaceTable& interfaceList) { return enumerateWith(backend, interfaceList, filter); });
+}
+
+// Function to spawn a build with BENCH_EXEC_ARGUMENTS, output to /dev/null; returns the time to exit, or -1 on failure
+inline std::int64_t spawnOnce(const char* program) {
+    std::vector<char*> arguments{const_cast<char*>(program)};
+    for (const char* argument : BENCH_EXEC_ARGUMENTS) {
+        arguments.push_back(const_cast<char*>(argument));
+    }
+    arguments.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    std::int64_t start{monotonicNanoseconds()};
+    pid_t pid;
+    int error{posix_spawn(&pid, program, &actions, nullptr, arguments.data(), environ)};
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        return -1;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    std::int64_t elapsed{monotonicNanoseconds() - start};
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : -1;
+}
+
+// Function to measure the exec-to-exit time of a build; a build that was not made is reported as unavailable
+inline bool benchExec(const char* program) {
+    if (access(program, X_OK) != 0) {
+        std::printf("%-24s %8s  unavailable\n", program, "-");
+        return true;
+    }
+    int runs{0};
+    std::int64_t elapsed{0};
+    std::int64_t fastest{0};
+    while (runs < BENCH_MINIMUM_RUNS || elapsed < BENCH_MINIMUM_NS) {
+        std::int64_t run{spawnOnce(program)};
+        if (run < 0) {
+            std::printf("%-24s %8d  FAILED\n", program, runs);
+            return false;
+        }
+        elapsed += run;
+        fastest = runs == 0 || run < fastest ? run : fastest;
+        ++runs;
+    }
+    std::printf("%-24s %8d %12.1f %12.1f\n", program, runs, static_cast<double>(elapsed) / runs / 1e3,
+                static_cast<double>(fastest) / 1e3);
+    return true;
+}
+
+// Function to run a measurement in a child process, so that it has its own peak RSS; returns false if it failed
+template <typename Bench>
+bool runIsolated(Bench&& bench) {
+    std::fflush(stdout);
+    pid_t pid{fork()};
+    if (pid < 0) {
+        std::perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        bool succeeded{bench()};
+        std::fflush(stdout);
+        _exit(succeeded ? 0 : 1);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::size_t> sizes;
+    for (int i = 1; i < argc; ++i) {
+        char* end{nullptr};
+        unsigned long size{std::strtoul(argv[i], &end, 10)};
+        if (*end != '\0' || size == 0) {
+            std::fprintf(stderr, "Usage: %s [INTERFACES...]\n", argv[0]);
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty()) {
+        sizes.assign(std::begin(BENCH_SIZES), std::end(BENCH_SIZES));
+    }
+
+    std::printf("%-16s %10s %10s %12s %8s %10s %12s %10s %12s %10s %10s\n", "variant", "interfaces", "addresses",
+                "input_bytes", "runs", "MB/s", "interfaces/s", "allocs", "alloc_KiB", "peak_KiB", "parse_KiB");
+    bool succeeded{true};
+    for (std::size_t size : sizes) {
+        succeeded = runIsolated([&] { return benchIpCommand(size); }) && succeeded;
+        succeeded = runIsolated([&] { return benchNetlink(size); }) && succeeded;
+        succeeded = runIsolated([&] { return benchImage(size); }) && succeeded;
+    }
+    for (Backend backend : BACKEND_PREFERENCE) {
+        succeeded = runIsolated([&] { return benchHostBackend(backend); }) && succeeded;
+    }
+
+    std::printf("\n%-24s %8s %12s %12s\n", "exec", "runs", "mean_us", "min_us");
+    for (const char* program : BENCH_EXEC_PROGRAMS) {
+        succeeded = benchExec(program) && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+/*
+ * console.hpp - Messages, help text and prompt input over raw file descriptors.
+ *
+ * Nothing in ifacepicker uses iostreams: for a one-shot run from a script, setting them up (std::ios_base::Init, the
+ * locale) costs about as much as enumerating the interfaces. Diagnostics are composed with operator<< the same way,
+ * into a ConsoleMessage that is written with a single write(2) when the statement ends:
+ *     errorMessage() << "Invalid address: " << value << '\n';
+ * and the few reads of stdin (the prompt, batch selectors) use read(2).
+ */
+
+#ifndef IFACEPICKER_CONSOLE_HPP
+#define IFACEPICKER_CONSOLE_HPP
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+class ConsoleMessage {
+public:
+    explicit ConsoleMessage(int fd) : fd{fd} {}
+    ConsoleMessage(const ConsoleMessage&) = delete;
+    ConsoleMessage& operator=(const ConsoleMessage&) = delete;
+    ~ConsoleMessage() { flush(); }
+
+    ConsoleMessage& operator<<(std::string_view part) {
+        text += part;
+        return *this;
+    }
+    ConsoleMessage& operator<<(const char* part) { return *this << std::string_view{part}; }
+    ConsoleMessage& operator<<(const std::string& part) { return *this << std::string_view{part}; }
+    ConsoleMessage& operator<<(char c) {
+        text += c;
+        return *this;
+    }
+    template <typename Number, std::enable_if_t<std::is_integral_v<Number>, int> = 0>
+    ConsoleMessage& operator<<(Number number) {
+        char digits[24];
+        auto result{std::to_chars(digits, digits + sizeof(digits), number)};
+        text.append(digits, result.ptr);
+        return *this;
+    }
+
+    // Write what has been composed so far
+    void flush() {
+        const char* data{text.data()};
+        std::size_t size{text.size()};
+        while (size > 0) {
+            ssize_t written{write(fd, data, size)};
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                break;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        text.clear();
+    }
+
+private:
+    int fd;
+    std::string text;
+};
+
+// Function to start a message on stderr, written once the statement is complete
+inline ConsoleMessage errorMessage() { return ConsoleMessage{STDERR_FILENO}; }
+
+// Function to read one line (without its newline) from a descriptor, a byte at a time; false at end of input
+inline bool readLine(int fd, std::string& line) {
+    line.clear();
+    char c;
+    while (true) {
+        ssize_t length{read(fd, &c, 1)};
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return !line.empty();
+        }
+        if (c == '\n') {
+            return true;
+        }
+        line += c;
+    }
+}
+
+// Function to read everything left on a descriptor; returns false on a read error
+inline bool readAll(int fd, std::string& text) {
+    char buffer[4096];
+    while (true) {
+        ssize_t length{read(fd, buffer, sizeof(buffer))};
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0) {
+            return false;
+        }
+        if (length == 0) {
+            return true;
+        }
+        text.append(buffer, static_cast<std::size_t>(length));
+    }
+}
+
+#endif // IFACEPICKER_CONSOLE_HPP
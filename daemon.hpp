@@ -0,0 +1,442 @@
+/*
+ * daemon.hpp - Long-running interface cache answering queries over a Unix domain socket.
+ *
+ * `ifacepicker --daemon` keeps an InterfaceMonitor (see live_state.hpp) up to date from rtnetlink notifications.
+ * Clients send a fixed-size DaemonRequest (filters and an optional interface name) and get back a DaemonReplyHeader
+ * followed by an InterfaceTable image, so selection and output stay in the client and behave exactly as with any
+ * other backend. The normal CLI tries the daemon first (see Backend::Daemon) and falls back to enumerating by itself
+ * when no daemon is listening. The same table is also published as a shared-memory snapshot (see snapshot.hpp),
+ * which clients read without contacting the daemon at all.
+ */
+
+#ifndef IFACEPICKER_DAEMON_HPP
+#define IFACEPICKER_DAEMON_HPP
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "console.hpp"
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "live_state.hpp"
+#include "snapshot.hpp"
+#include "timings.hpp"
+
+// Protocol identification; the version changes whenever a request, reply or table image layout changes
+constexpr std::uint32_t DAEMON_MAGIC{0x69667063}; // "ifpc"
+constexpr std::uint32_t DAEMON_VERSION{1};
+
+// Default socket path, overridden by the IFACEPICKER_SOCKET environment variable or --socket
+constexpr const char* DAEMON_SOCKET_PATH{"/run/ifacepicker.sock"};
+
+// How long either side waits for the other before giving up on a connection
+constexpr int DAEMON_TIMEOUT_MS{1000};
+
+// Connections the daemon serves at once; more wait in the listen backlog
+constexpr std::size_t DAEMON_MAX_CLIENTS{256};
+
+struct DaemonRequest {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::int32_t family;  // InterfaceFilter::family
+    std::uint8_t upOnly;  // InterfaceFilter::upOnly
+    char linkType[32];    // InterfaceFilter::linkType, NUL-terminated
+    char name[IFNAMSIZ];  // Only this interface, or all of them if empty
+};
+
+struct DaemonReplyHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t status; // 0 on success, otherwise an errno value and no table follows
+};
+
+// Function to get the Unix socket path used by the daemon and its clients
+inline std::string& daemonSocketPath() {
+    static std::string path{std::getenv("IFACEPICKER_SOCKET") != nullptr ? std::getenv("IFACEPICKER_SOCKET")
+                                                                           : DAEMON_SOCKET_PATH};
+    return path;
+}
+
+// Function to fill a sockaddr_un with a path; returns false if the path does not fit
+inline bool makeUnixAddress(const std::string& path, sockaddr_un& address) {
+    address = sockaddr_un{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Function to apply a send/receive timeout to a socket
+inline void setSocketTimeout(int fd, int milliseconds) {
+    timeval timeout{milliseconds / 1000, (milliseconds % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// Function to write a whole buffer to a (blocking) descriptor
+inline bool writeAll(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written{send(fd, data, size, MSG_NOSIGNAL)};
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Function to append a successful reply (header and table image) to `out`; also the output of --format=image
+inline void appendDaemonReply(OutputBuffer& out, const InterfaceTable& interfaceList) {
+    DaemonReplyHeader header{DAEMON_MAGIC, DAEMON_VERSION, 0};
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    interfaceList.appendImage(out);
+}
+
+// Function to load the table from a complete reply; returns false if it is malformed or reports an error
+inline bool parseDaemonReply(std::string_view reply, InterfaceTable& interfaceList) {
+    DaemonReplyHeader header;
+    if (reply.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, reply.data(), sizeof(header));
+    if (header.magic != DAEMON_MAGIC || header.version != DAEMON_VERSION || header.status != 0) {
+        return false;
+    }
+    return interfaceList.loadImage(reply.data() + sizeof(header), reply.size() - sizeof(header));
+}
+
+// Function to fill a request for the interfaces matching the filter (or only `name`, if not null)
+inline DaemonRequest makeDaemonRequest(const InterfaceFilter& filter, const char* name = nullptr) {
+    DaemonRequest request{};
+    request.magic = DAEMON_MAGIC;
+    request.version = DAEMON_VERSION;
+    request.family = filter.family;
+    request.upOnly = filter.upOnly;
+    std::strncpy(request.linkType, filter.linkType.c_str(), sizeof(request.linkType) - 1);
+    if (name != nullptr) {
+        std::strncpy(request.name, name, IFNAMSIZ - 1);
+    }
+    return request;
+}
+
+/*
+ * Ask a running daemon for the interfaces matching the filter (or only `name`, if not null).
+ * Returns false, leaving the table empty, if no daemon answers; the caller then enumerates by itself.
+ */
+inline bool queryDaemon(InterfaceTable& interfaceList, const InterfaceFilter& filter, const char* name = nullptr) {
+    sockaddr_un address;
+    if (!makeUnixAddress(daemonSocketPath(), address)) {
+        return false;
+    }
+    TimedPhase openPhase{Phase::Open};
+    DescriptorGuard guard{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (guard.fd < 0 || connect(guard.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+        return false;
+    }
+    openPhase.stop();
+    setSocketTimeout(guard.fd, DAEMON_TIMEOUT_MS);
+
+    DaemonRequest request{makeDaemonRequest(filter, name)};
+    if (!writeAll(guard.fd, reinterpret_cast<const char*>(&request), sizeof(request))) {
+        return false;
+    }
+
+    // The daemon closes the connection after its reply
+    OutputBuffer reply{interfaceList.resource()};
+    char buffer[65536];
+    for (;;) {
+        ssize_t length{recv(guard.fd, buffer, sizeof(buffer), 0)};
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0) {
+            return false;
+        }
+        if (length == 0) {
+            break;
+        }
+        reply.append(buffer, static_cast<std::size_t>(length));
+        timings().count(Counter::BytesRead, static_cast<std::uint64_t>(length));
+    }
+
+    return parseDaemonReply(reply, interfaceList);
+}
+
+// Set by the SIGINT/SIGTERM handler to stop the daemon loop
+inline volatile std::sig_atomic_t& daemonStopRequested() {
+    static volatile std::sig_atomic_t stop{0};
+    return stop;
+}
+
+// A connection being served: its request is read, then its reply written, as far as the socket allows each time
+struct DaemonClient {
+    int fd{-1};
+    std::int64_t deadlineNs{0}; // Closed unserved at this CLOCK_MONOTONIC time
+    DaemonRequest request{};
+    std::size_t received{0};
+    bool replying{false};
+    OutputBuffer reply;
+    std::size_t sent{0};
+};
+
+/*
+ * Server side of the daemon: owns the live state, the notification socket and the listening socket.
+ * - start(): Subscribes to the multicast groups, loads the initial state and starts listening.
+ * - run(): Serves clients and applies notifications until SIGINT/SIGTERM.
+ */
+class InterfaceDaemon {
+public:
+    InterfaceDaemon(std::string path, std::string snapshotFile)
+        : socketPath{std::move(path)}, snapshot{std::move(snapshotFile)} {}
+
+    ~InterfaceDaemon() {
+        if (listener >= 0) {
+            close(listener);
+            unlink(socketPath.c_str());
+        }
+    }
+
+    bool start() {
+        if (!monitor.start() || !listen()) {
+            return false;
+        }
+        publish();
+        return true;
+    }
+
+    int run() {
+        struct sigaction action{};
+        action.sa_handler = [](int) { daemonStopRequested() = 1; };
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        signal(SIGPIPE, SIG_IGN);
+
+        errorMessage() << "Listening on " << socketPath << " (" << monitor.state().size() << " interfaces)" << '\n';
+        std::vector<pollfd> descriptors;
+        while (!daemonStopRequested()) {
+            // The notifications, the listener while there is room for another client, then each client
+            descriptors.assign({{monitor.descriptor(), POLLIN, 0}, {listener, POLLIN, 0}});
+            if (clients.size() >= DAEMON_MAX_CLIENTS) {
+                descriptors[1].events = 0;
+            }
+            for (const DaemonClient& client : clients) {
+                descriptors.push_back({client.fd, static_cast<short>(client.replying ? POLLOUT : POLLIN), 0});
+            }
+            if (poll(descriptors.data(), descriptors.size(), pollTimeout()) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                errorMessage() << "Error waiting for events: " << std::strerror(errno) << '\n';
+                return 1;
+            }
+            if (descriptors[0].revents & POLLIN) {
+                monitor.applyNotifications();
+                publish();
+            }
+            // Clients accepted below are not in `descriptors` yet, and are only served on the next round
+            std::size_t polled{clients.size()};
+            if (descriptors[1].revents & POLLIN) {
+                acceptClients();
+            }
+            serveClients(descriptors.data() + 2, polled);
+        }
+        for (DaemonClient& client : clients) {
+            close(client.fd);
+        }
+        return 0;
+    }
+
+    LiveInterfaceState& liveState() { return monitor.state(); }
+
+private:
+    bool listen() {
+        sockaddr_un address;
+        if (!makeUnixAddress(socketPath, address)) {
+            errorMessage() << "Socket path too long: " << socketPath << '\n';
+            return false;
+        }
+
+        // A socket file nobody answers on is left over from a daemon that did not exit cleanly
+        DescriptorGuard probe{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+        if (connect(probe.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            errorMessage() << "A daemon is already listening on " << socketPath << '\n';
+            return false;
+        }
+        unlink(socketPath.c_str());
+
+        // Non-blocking, so that acceptClients() can take every pending connection and stop when there are no more
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+            ::listen(listener, 128) < 0) {
+            errorMessage() << "Error listening on " << socketPath << ": " << std::strerror(errno) << '\n';
+            return false;
+        }
+
+        // Anyone may ask: the same information is readable by every user with 'ip a'
+        chmod(socketPath.c_str(), 0666);
+        return true;
+    }
+
+    // Publish the table to the snapshot if it changed since the last time; readers fall back to the socket if not
+    void publish() {
+        if (publishedGeneration == monitor.state().generation()) {
+            return;
+        }
+        if (!snapshot.publish(monitor.state().fullImage()) && !snapshotFailed) {
+            errorMessage() << "Error writing " << snapshot.path() << ": " << std::strerror(errno) << '\n';
+            snapshotFailed = true;
+        }
+        publishedGeneration = monitor.state().generation();
+    }
+
+    // Function to accept the pending connections, non-blocking, as long as there is room for them
+    void acceptClients() {
+        while (clients.size() < DAEMON_MAX_CLIENTS) {
+            int fd{accept4(listener, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)};
+            if (fd < 0) {
+                return;
+            }
+            DaemonClient& client{clients.emplace_back()};
+            client.fd = fd;
+            client.deadlineNs = monotonicNanoseconds() + static_cast<std::int64_t>(DAEMON_TIMEOUT_MS) * 1000000;
+        }
+    }
+
+    // Function to get the poll(2) timeout: until the next client deadline, or none without clients
+    int pollTimeout() const {
+        if (clients.empty()) {
+            return -1;
+        }
+        std::int64_t deadlineNs{clients.front().deadlineNs};
+        for (const DaemonClient& client : clients) {
+            deadlineNs = std::min(deadlineNs, client.deadlineNs);
+        }
+        std::int64_t remainingNs{deadlineNs - monotonicNanoseconds()};
+        return remainingNs <= 0 ? 0 : static_cast<int>(remainingNs / 1000000 + 1);
+    }
+
+    /*
+     * Advance the first `polled` clients as far as their sockets allow without blocking, with the poll(2) results
+     * of each, and drop those that are done, failed or past their deadline. A client that is slow to send its request
+     * or to read its reply only holds its own slot, never the other clients.
+     */
+    void serveClients(const pollfd* descriptors, std::size_t polled) {
+        std::int64_t nowNs{monotonicNanoseconds()};
+        std::size_t kept{0};
+        for (std::size_t i = 0; i < clients.size(); ++i) {
+            DaemonClient& client{clients[i]};
+            bool ready{i < polled && descriptors[i].revents != 0};
+            bool open{(ready ? advanceClient(client) : true) && nowNs < client.deadlineNs};
+            if (!open) {
+                close(client.fd);
+                continue;
+            }
+            if (kept != i) {
+                clients[kept] = std::move(client);
+            }
+            ++kept;
+        }
+        clients.resize(kept);
+    }
+
+    // Function to read what the client sent or write what it can take of its reply; false once it is to be closed
+    bool advanceClient(DaemonClient& client) {
+        if (!client.replying) {
+            auto* request{reinterpret_cast<char*>(&client.request)};
+            ssize_t length{recv(client.fd, request + client.received, sizeof(client.request) - client.received, 0)};
+            if (length < 0 && (errno == EINTR || errno == EAGAIN)) {
+                return true;
+            }
+            if (length <= 0) {
+                return false;
+            }
+            client.received += static_cast<std::size_t>(length);
+            if (client.received < sizeof(client.request)) {
+                return true;
+            }
+            prepareReply(client);
+        }
+        while (client.sent < client.reply.size()) {
+            ssize_t written{send(client.fd, client.reply.data() + client.sent, client.reply.size() - client.sent,
+                                 MSG_NOSIGNAL)};
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written < 0) {
+                return errno == EAGAIN;
+            }
+            client.sent += static_cast<std::size_t>(written);
+        }
+        return false;
+    }
+
+    // Function to compose the reply to a complete request, from the live state as it is now
+    void prepareReply(DaemonClient& client) {
+        client.replying = true;
+        DaemonRequest& request{client.request};
+        DaemonReplyHeader header{DAEMON_MAGIC, DAEMON_VERSION, 0};
+        if (request.magic != DAEMON_MAGIC || request.version != DAEMON_VERSION) {
+            header.status = EPROTO;
+            client.reply.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+            return;
+        }
+        request.linkType[sizeof(request.linkType) - 1] = '\0';
+        request.name[IFNAMSIZ - 1] = '\0';
+
+        InterfaceFilter filter;
+        filter.family = request.family;
+        filter.upOnly = request.upOnly != 0;
+        filter.linkType = request.linkType;
+
+        client.reply.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+        if (request.name[0] == '\0' && filter.family == AF_UNSPEC && !filter.upOnly && !filter.hasLinkType()) {
+            client.reply += monitor.state().fullImage();
+        } else {
+            InterfaceTable interfaceList;
+            monitor.state().snapshot(filter, request.name, interfaceList);
+            interfaceList.appendImage(client.reply);
+        }
+    }
+
+    std::string socketPath;
+    InterfaceMonitor monitor;
+    int listener{-1};
+    std::vector<DaemonClient> clients;
+    SnapshotPublisher snapshot;
+    std::uint64_t publishedGeneration{static_cast<std::uint64_t>(-1)};
+    bool snapshotFailed{false}; // Only reported once
+};
+
+// Function to run `ifacepicker --daemon` in the foreground; returns the exit status
+inline int runDaemon() {
+    InterfaceDaemon daemon{daemonSocketPath(), snapshotPath()};
+    if (!daemon.start()) {
+        return 1;
+    }
+    return daemon.run();
+}
+
+#endif // IFACEPICKER_DAEMON_HPP
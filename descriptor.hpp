@@ -0,0 +1,24 @@
+/*
+ * descriptor.hpp - Ownership of raw file descriptors.
+ */
+
+#ifndef IFACEPICKER_DESCRIPTOR_HPP
+#define IFACEPICKER_DESCRIPTOR_HPP
+
+#include <unistd.h>
+
+// Closes a file descriptor when it goes out of scope
+struct DescriptorGuard {
+    int fd;
+
+    explicit DescriptorGuard(int descriptor) : fd{descriptor} {}
+    DescriptorGuard(const DescriptorGuard&) = delete;
+    DescriptorGuard& operator=(const DescriptorGuard&) = delete;
+    ~DescriptorGuard() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+#endif // IFACEPICKER_DESCRIPTOR_HPP
@@ -0,0 +1,359 @@
+/*
+ * fields.hpp - Output templates (--fields).
+ *
+ * --fields name,ip,mac,mtu,speed chooses which attributes of each printed interface are output, and in which order.
+ * The table only holds what every run needs (name, index, flags, addresses); the other attributes are resolved when an
+ * interface is printed, and only for the fields of the template:
+ *   mac, mtu, operstate  Decoded from the IFLA_ADDRESS, IFLA_MTU and IFLA_OPERSTATE attributes of the RTM_NEWLINK
+ *                        reply, which the netlink backend attaches to the table, still encoded, only when the template
+ *                        asks for them; read from /sys/class/net/<name> with the other backends
+ *   speed                /sys/class/net/<name>/speed in Mb/s, or the ETHTOOL_GSET ioctl where sysfs is not mounted
+ *   numa, cpus           device/numa_node and device/local_cpulist: where the NIC is attached, on multi-socket hosts
+ *   duplex, carrier      duplex ("full", "half"...) and carrier (1 with a link, 0 without; unknown while down)
+ *   driver               The name the device/driver symlink points to, e.g. "e1000e"
+ *   rx_rate, tx_rate,    Bytes and packets per second, and the utilisation of the link in percent (load), from the
+ *   rx_pps, tx_pps, load counters sampled once for the whole table before printing (see load.hpp)
+ * Listing with --fields name,ip therefore costs nothing more than the default output, and --iface eth0 --fields speed
+ * reads a single sysfs file. When the whole table is listed, the sysfs attributes of the template are read for every
+ * interface at once beforehand (see sysfs_batch.hpp and setAttributes). Attributes the interface does not have (e.g.
+ * the speed of a link that is down) are unknown: an empty field, or null in JSON.
+ */
+
+#ifndef IFACEPICKER_FIELDS_HPP
+#define IFACEPICKER_FIELDS_HPP
+
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "arena.hpp"
+#include "interface_table.hpp"
+#include "load.hpp"
+#include "netlink.hpp"
+#include "sysfs.hpp"
+#include "sysfs_batch.hpp"
+
+enum class Field {
+    Name, Index, Ip, Mac, Mtu, Operstate, Speed, Numa, Cpus, Duplex, Carrier, Driver, RxRate, TxRate, RxPackets,
+    TxPackets, Load
+};
+
+// Names of a field: in --fields and JSON, as an env key, and as a label in the interactive list; in Field order
+struct FieldNames {
+    const char* name;
+    const char* envKey;
+    const char* label;
+};
+constexpr FieldNames FIELD_NAMES[]{{"name", "IFACE", "Interface"},        {"index", "INDEX", "Index"},
+                                   {"ip", "IPADDR", "IP"},                {"mac", "MAC", "MAC"},
+                                   {"mtu", "MTU", "MTU"},                 {"operstate", "OPERSTATE", "State"},
+                                   {"speed", "SPEED", "Speed"},           {"numa", "NUMA_NODE", "NUMA node"},
+                                   {"cpus", "LOCAL_CPUS", "Local CPUs"},  {"duplex", "DUPLEX", "Duplex"},
+                                   {"carrier", "CARRIER", "Carrier"},     {"driver", "DRIVER", "Driver"},
+                                   {"rx_rate", "RX_BPS", "RX B/s"},       {"tx_rate", "TX_BPS", "TX B/s"},
+                                   {"rx_pps", "RX_PPS", "RX packets/s"},  {"tx_pps", "TX_PPS", "TX packets/s"},
+                                   {"load", "LOAD", "Load %"}};
+constexpr std::size_t FIELD_COUNT{std::size(FIELD_NAMES)};
+
+// Function to get the names of a field
+constexpr const FieldNames& fieldNames(Field field) {
+    return FIELD_NAMES[static_cast<int>(field)];
+}
+
+// Whether a field is one of the traffic rates, which need the counters sampled over an interval (see load.hpp)
+constexpr bool isRateField(Field field) {
+    return field >= Field::RxRate && field <= Field::Load;
+}
+
+// Whether a field is a string (quoted in JSON) rather than a number
+constexpr bool isTextField(Field field) {
+    return field != Field::Index && field != Field::Mtu && field != Field::Speed && field != Field::Numa &&
+           field != Field::Carrier && !isRateField(field);
+}
+
+// IF_OPER_* values as the kernel names them in sysfs
+constexpr const char* OPERSTATE_NAMES[]{"unknown", "notpresent", "down", "lowerlayerdown", "testing", "dormant", "up"};
+
+// Function to append a link-layer address as colon-separated hex bytes
+inline void appendLinkAddress(OutputBuffer& out, const unsigned char* address, std::size_t length) {
+    constexpr const char* DIGITS{"0123456789abcdef"};
+    for (std::size_t i = 0; i < length; ++i) {
+        if (i > 0) {
+            out += ':';
+        }
+        out += DIGITS[address[i] >> 4];
+        out += DIGITS[address[i] & 0x0f];
+    }
+}
+
+class FieldTemplate {
+public:
+    // Parse a comma-separated list of field names; returns false (naming the culprit) on an unknown or empty one
+    bool parse(std::string_view text, std::string& unknown) {
+        list.clear();
+        while (true) {
+            std::size_t comma{text.find(',')};
+            std::string_view name{text.substr(0, comma)};
+            bool found{false};
+            for (int i = 0; i < static_cast<int>(FIELD_COUNT); ++i) {
+                if (name == FIELD_NAMES[i].name) {
+                    list.push_back(static_cast<Field>(i));
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                unknown = name;
+                list.clear();
+                return false;
+            }
+            if (comma == std::string_view::npos) {
+                return true;
+            }
+            text.remove_prefix(comma + 1);
+        }
+    }
+
+    bool empty() const { return list.empty(); }
+    const std::vector<Field>& fields() const { return list; }
+
+    // Whether the template has a traffic rate field, for which the counters must be sampled (see setLoad)
+    bool needsLoad() const {
+        for (Field field : list) {
+            if (isRateField(field)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Rates sampled for the rate fields; without them the rate fields are unknown
+    void setLoad(LinkLoad* sampled) { load = sampled; }
+
+    // Whether the template has a field decoded from the link attributes the netlink backend can attach to the table
+    bool needsLinkAttributes() const {
+        for (Field field : list) {
+            if (field == Field::Mac || field == Field::Mtu || field == Field::Operstate) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * The attributes (sysfsAttributeBit()s) the template reads from sysfs for the interfaces of a table: mac, mtu and
+     * operstate only if the backend did not attach the link attributes.
+     */
+    unsigned int sysfsAttributes(const InterfaceTable& interfaceList) const {
+        unsigned int attributes{0};
+        for (Field field : list) {
+            switch (field) {
+            case Field::Speed:
+                attributes |= sysfsAttributeBit(SysfsAttribute::Speed);
+                break;
+            case Field::Numa:
+                attributes |= sysfsAttributeBit(SysfsAttribute::NumaNode);
+                break;
+            case Field::Cpus:
+            case Field::Duplex:
+            case Field::Carrier:
+            case Field::Driver:
+                attributes |= sysfsAttributeBit(sysfsAttributeOf(field));
+                break;
+            case Field::Mac:
+            case Field::Mtu:
+            case Field::Operstate:
+                if (!interfaceList.hasLinkAttributes()) {
+                    attributes |= sysfsAttributeBit(field == Field::Mac   ? SysfsAttribute::Address
+                                                     : field == Field::Mtu ? SysfsAttribute::Mtu
+                                                                           : SysfsAttribute::Operstate);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return attributes;
+    }
+
+    // Attributes read beforehand for the table being printed; the others are read when a field needs them
+    void setAttributes(const SysfsAttributes* read) { attributes = read; }
+
+    /*
+     * Append the value of a field that is not in the table (mac, mtu, operstate, speed, numa, cpus, duplex...
+     * or a rate) for an interface, resolving it now. Returns false, appending nothing, if the attribute is unknown.
+     */
+    bool appendLinkValue(OutputBuffer& out, Field field, const InterfaceTable& interfaceList,
+                         const InterfaceRecord& record) {
+        if (isRateField(field)) {
+            return appendRate(out, field, record);
+        }
+        char buffer[256];
+        std::string_view value;
+        if (attributes != nullptr && attributes->has(sysfsAttributeOf(field))) {
+            return appendCollected(out, field, interfaceList.positionOf(record));
+        }
+        switch (field) {
+        case Field::Speed:
+        case Field::Numa: {
+            long number{field == Field::Speed ? readLinkSpeed(record.name) : readNumaNode(record.nameView())};
+            if (number == SYSFS_UNKNOWN) {
+                return false;
+            }
+            out += std::to_string(number);
+            return true;
+        }
+        case Field::Cpus:
+        case Field::Duplex:
+        case Field::Carrier:
+        case Field::Driver:
+            if (!readSysfsAttribute(record.nameView(), sysfsAttributeOf(field), buffer, sizeof(buffer), value)) {
+                return false;
+            }
+            out += value;
+            return true;
+        default:
+            break;
+        }
+
+        std::string_view attached{interfaceList.linkAttributes(record)};
+        if (!attached.empty()) {
+            const rtattr* attributes[IFLA_MAX + 1];
+            parseAttributes(reinterpret_cast<const rtattr*>(attached.data()), static_cast<int>(attached.size()),
+                            attributes, IFLA_MAX);
+            return appendDecoded(out, field, attributes);
+        }
+
+        // Not attached (another backend, or the daemon's table): ask sysfs
+        const char* attribute{field == Field::Mac ? "address" : field == Field::Mtu ? "mtu" : "operstate"};
+        if (!readInterfaceAttribute(record.nameView(), attribute, buffer, sizeof(buffer), value)) {
+            return false;
+        }
+        out += value;
+        return true;
+    }
+
+private:
+    // The sysfs attribute a field not in the table is read from (for mac, mtu and operstate, without link attributes)
+    static SysfsAttribute sysfsAttributeOf(Field field) {
+        switch (field) {
+        case Field::Speed:
+            return SysfsAttribute::Speed;
+        case Field::Numa:
+            return SysfsAttribute::NumaNode;
+        case Field::Cpus:
+            return SysfsAttribute::LocalCpus;
+        case Field::Duplex:
+            return SysfsAttribute::Duplex;
+        case Field::Carrier:
+            return SysfsAttribute::Carrier;
+        case Field::Driver:
+            return SysfsAttribute::Driver;
+        case Field::Mac:
+            return SysfsAttribute::Address;
+        case Field::Mtu:
+            return SysfsAttribute::Mtu;
+        default:
+            return SysfsAttribute::Operstate;
+        }
+    }
+
+    // Function to append a field from the attributes read beforehand; false if unknown
+    bool appendCollected(OutputBuffer& out, Field field, std::size_t position) const {
+        SysfsAttribute attribute{sysfsAttributeOf(field)};
+        if (field == Field::Speed || field == Field::Numa) {
+            long number{attributes->number(position, attribute)};
+            number = field == Field::Speed ? knownLinkSpeed(number) : number < 0 ? SYSFS_UNKNOWN : number;
+            if (number == SYSFS_UNKNOWN) {
+                return false;
+            }
+            out += std::to_string(number);
+            return true;
+        }
+        std::string_view value;
+        if (!attributes->value(position, attribute, value)) {
+            return false;
+        }
+        out += value;
+        return true;
+    }
+
+    // Function to append a rate, rounded to an integer, or the load in percent with one decimal
+    bool appendRate(OutputBuffer& out, Field field, const InterfaceRecord& record) {
+        const LinkRates* rates{load != nullptr ? load->rates(record.index) : nullptr};
+        if (rates == nullptr) {
+            return false;
+        }
+        char text[32];
+        switch (field) {
+        case Field::RxRate:
+            std::snprintf(text, sizeof(text), "%.0f", rates->rxBytes);
+            break;
+        case Field::TxRate:
+            std::snprintf(text, sizeof(text), "%.0f", rates->txBytes);
+            break;
+        case Field::RxPackets:
+            std::snprintf(text, sizeof(text), "%.0f", rates->rxPackets);
+            break;
+        case Field::TxPackets:
+            std::snprintf(text, sizeof(text), "%.0f", rates->txPackets);
+            break;
+        default: {
+            double utilisation{load->utilisation(record)};
+            if (utilisation < 0) {
+                return false;
+            }
+            std::snprintf(text, sizeof(text), "%.1f", utilisation * 100);
+            break;
+        }
+        }
+        out += text;
+        return true;
+    }
+
+    // Function to append a field from decoded IFLA_* attributes
+    static bool appendDecoded(OutputBuffer& out, Field field, const rtattr* const* attributes) {
+        switch (field) {
+        case Field::Mac: {
+            const rtattr* address{attributes[IFLA_ADDRESS]};
+            if (address == nullptr || RTA_PAYLOAD(address) == 0) {
+                return false;
+            }
+            appendLinkAddress(out, static_cast<const unsigned char*>(RTA_DATA(address)), RTA_PAYLOAD(address));
+            return true;
+        }
+        case Field::Mtu: {
+            if (attributes[IFLA_MTU] == nullptr) {
+                return false;
+            }
+            std::uint32_t mtu;
+            std::memcpy(&mtu, RTA_DATA(attributes[IFLA_MTU]), sizeof(mtu));
+            out += std::to_string(mtu);
+            return true;
+        }
+        case Field::Operstate: {
+            if (attributes[IFLA_OPERSTATE] == nullptr) {
+                return false;
+            }
+            std::uint8_t state{*static_cast<const std::uint8_t*>(RTA_DATA(attributes[IFLA_OPERSTATE]))};
+            out += state < std::size(OPERSTATE_NAMES) ? OPERSTATE_NAMES[state] : OPERSTATE_NAMES[0];
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    std::vector<Field> list;
+    LinkLoad* load{nullptr};
+    const SysfsAttributes* attributes{nullptr};
+};
+
+#endif // IFACEPICKER_FIELDS_HPP
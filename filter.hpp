@@ -0,0 +1,70 @@
+/*
+ * filter.hpp - Interface and address filters applied while enumerating.
+ *
+ * Filters are handed to the backends so that interfaces and addresses that do not match are dropped as they are
+ * parsed (or not returned by the kernel at all) instead of being stored and discarded later:
+ *   --family inet|inet6   Only addresses of that family
+ *   --up-only             Only interfaces that are up with carrier
+ *   --type KIND           Only interfaces of that link type: "ether" for plain Ethernet devices, or an rtnetlink
+ *                         link kind such as veth, bond, bridge or vlan
+ */
+
+#ifndef IFACEPICKER_FILTER_HPP
+#define IFACEPICKER_FILTER_HPP
+
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <string_view>
+
+// Link type meaning "Ethernet device without an rtnetlink link kind" (a physical or paravirtual NIC)
+constexpr std::string_view LINK_TYPE_ETHER{"ether"};
+
+struct InterfaceFilter {
+    int family{AF_UNSPEC}; // AF_UNSPEC: addresses of any family
+    bool upOnly{false};
+    std::string linkType;  // Empty: any link type
+
+    bool acceptsFamily(int addressFamily) const { return family == AF_UNSPEC || family == addressFamily; }
+
+    // Same rule as InterfaceRecord::isUp()
+    bool acceptsFlags(unsigned int flags) const {
+        return !upOnly || (flags & (IFF_UP | IFF_RUNNING | IFF_LOOPBACK)) == (IFF_UP | IFF_RUNNING);
+    }
+
+    bool hasLinkType() const { return !linkType.empty(); }
+
+    // A link kind the kernel can filter on by itself (everything except "ether")
+    bool hasLinkKind() const { return hasLinkType() && linkType != LINK_TYPE_ETHER; }
+
+    /*
+     * Check the link type of an interface.
+     * - kind: IFLA_INFO_KIND of the link, empty for devices without one.
+     * - hardwareType: ARPHRD_* type of the link.
+     */
+    bool acceptsLinkType(std::string_view kind, unsigned short hardwareType) const {
+        if (!hasLinkType()) {
+            return true;
+        }
+        if (linkType == LINK_TYPE_ETHER) {
+            return kind.empty() && hardwareType == ARPHRD_ETHER;
+        }
+        return kind == linkType;
+    }
+};
+
+// Function to parse the --family value; returns false if it is neither inet nor inet6
+inline bool parseFamilyFilter(const std::string& text, InterfaceFilter& filter) {
+    if (text == "inet") {
+        filter.family = AF_INET;
+    } else if (text == "inet6") {
+        filter.family = AF_INET6;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif // IFACEPICKER_FILTER_HPP
@@ -0,0 +1,540 @@
+/*
+ * fleet.hpp - Collect the interfaces of many hosts concurrently (--hosts FILE).
+ *
+ * The hosts file lists one target per line (empty lines and '#' comments are skipped):
+ *   node17, user@node17         Run `ifacepicker --format=image` on the host over ssh (BatchMode, no prompts)
+ *   unix:/run/ifacepicker.sock  Ask an ifacepicker daemon on a Unix socket
+ *   tcp:node17:7000             Ask an ifacepicker daemon whose socket is forwarded to a TCP port (e.g. with socat)
+ * Every transport returns the same thing: a daemon reply (DaemonReplyHeader and table image, see daemon.hpp), so
+ * filters are applied remotely, while selection and output formatting happen locally exactly as for local tables.
+ *
+ * A single poll() loop drives at most `parallel` connections at a time; each one has its own deadline, after which
+ * the connection is closed (and ssh killed). Results are handed to the caller as soon as a host finishes, so output
+ * streams while slower hosts are still running.
+ *
+ * Output per host (appendHostResult), in the order hosts finish:
+ *   env   HOST=<target>, then the selected interface or every interface as for a local run (separated by empty
+ *         lines), or ERROR=<reason>; hosts are separated by empty lines too
+ *   json  One object per line: {"host", "interface"} with a selection, {"host", "interfaces"} without, or
+ *         {"host", "error"}
+ *   tsv   <target>TAB<name>TAB<address> lines (nul: NUL separated); failures are only reported on stderr
+ */
+
+#ifndef IFACEPICKER_FLEET_HPP
+#define IFACEPICKER_FLEET_HPP
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "console.hpp"
+#include "daemon.hpp"
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "output.hpp"
+#include "selector.hpp"
+
+extern char** environ;
+
+// Defaults for --parallel and --timeout
+constexpr std::size_t FLEET_PARALLEL{64};
+constexpr int FLEET_TIMEOUT_MS{10000};
+
+// Command run on ssh targets, overridden by --remote-command
+constexpr const char* FLEET_REMOTE_COMMAND{"ifacepicker"};
+
+struct FleetTarget {
+    enum class Kind { Ssh, Unix, Tcp };
+
+    Kind kind{Kind::Ssh};
+    std::string label; // The line of the hosts file, used to tag the results
+    std::string host;  // ssh destination, socket path or TCP host
+    std::string port;  // TCP port
+};
+
+struct FleetOptions {
+    std::size_t parallel{FLEET_PARALLEL};
+    int timeoutMs{FLEET_TIMEOUT_MS};
+    std::string remoteCommand{FLEET_REMOTE_COMMAND};
+};
+
+// Function to parse one line of the hosts file; returns false if it is malformed
+inline bool parseFleetTarget(const std::string& line, FleetTarget& target) {
+    target = FleetTarget{};
+    target.label = line;
+    if (line.compare(0, 5, "unix:") == 0) {
+        target.kind = FleetTarget::Kind::Unix;
+        target.host = line.substr(5);
+        return !target.host.empty();
+    }
+    if (line.compare(0, 4, "tcp:") == 0) {
+        std::size_t colon{line.rfind(':')};
+        target.kind = FleetTarget::Kind::Tcp;
+        target.host = line.substr(4, colon - 4);
+        target.port = line.substr(colon + 1);
+        if (target.host.size() > 2 && target.host.front() == '[' && target.host.back() == ']') {
+            target.host = target.host.substr(1, target.host.size() - 2); // [IPv6 address]
+        }
+        return colon > 4 && !target.host.empty() && !target.port.empty();
+    }
+    target.host = line;
+    return line.find_first_of(" \t") == std::string::npos;
+}
+
+// Function to read the targets of a hosts file; returns false if it cannot be read or has a malformed line
+inline bool readFleetTargets(const std::string& path, std::vector<FleetTarget>& targets, std::string& error) {
+    DescriptorGuard file{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    std::string text;
+    if (file.fd < 0 || !readAll(file.fd, text)) {
+        error = "Cannot read " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    std::string_view rest{text};
+    while (!rest.empty()) {
+        std::size_t end{rest.find('\n')};
+        std::string line{rest.substr(0, end)};
+        rest.remove_prefix(end == std::string_view::npos ? rest.size() : end + 1);
+        std::size_t first{line.find_first_not_of(" \t\r")};
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+        std::size_t last{line.find_last_not_of(" \t\r")};
+        FleetTarget& target{targets.emplace_back()};
+        if (!parseFleetTarget(line.substr(first, last - first + 1), target)) {
+            error = "Invalid host: " + line;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to quote an argument for the remote shell that ssh hands the command to
+inline std::string shellQuote(const std::string& text) {
+    std::string quoted{"'"};
+    for (char c : text) {
+        quoted += c == '\'' ? std::string{"'\\''"} : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+/*
+ * Runs the connections of a fleet collection.
+ * - run(): Collects every target, calling onResult(target, table, error) as each one finishes; `table` is null and
+ *   `error` describes the failure if the host could not be collected. Returns the number of failed hosts.
+ */
+class FleetCollector {
+public:
+    FleetCollector(const InterfaceFilter& interfaceFilter, const FleetOptions& fleetOptions)
+        : filter{interfaceFilter}, options{fleetOptions} {}
+
+    template <typename ResultHandler>
+    std::size_t run(const std::vector<FleetTarget>& targets, ResultHandler&& onResult) {
+        // A host that closes its end early must not kill the whole collection
+        signal(SIGPIPE, SIG_IGN);
+
+        std::size_t failures{0};
+        std::size_t next{0};
+        std::vector<Connection> active;
+        std::vector<pollfd> descriptors;
+        auto finish{[&](Connection& connection, std::string error) {
+            InterfaceTable interfaceList;
+            if (!error.empty()) {
+                connection.kill();
+            } else if (connection.closeAndReap(error) && !parseDaemonReply(connection.reply, interfaceList)) {
+                error = "invalid reply";
+            }
+            if (!error.empty()) {
+                ++failures;
+                onResult(*connection.target, static_cast<const InterfaceTable*>(nullptr), error);
+            } else {
+                onResult(*connection.target, &interfaceList, error);
+            }
+        }};
+
+        while (next < targets.size() || !active.empty()) {
+            // Top up the pool
+            while (next < targets.size() && active.size() < options.parallel) {
+                Connection connection{&targets[next++]};
+                std::string error;
+                if (!start(connection, error)) {
+                    finish(connection, error);
+                    continue;
+                }
+                active.push_back(std::move(connection));
+            }
+            if (active.empty()) {
+                break;
+            }
+
+            // Wait for the next event or the nearest deadline
+            std::int64_t now{monotonicMilliseconds()};
+            std::int64_t wait{options.timeoutMs};
+            descriptors.clear();
+            for (const Connection& connection : active) {
+                descriptors.push_back(pollfd{connection.fd, connection.writing() ? short{POLLOUT} : short{POLLIN}, 0});
+                wait = std::min(wait, std::max<std::int64_t>(connection.deadline - now, 0));
+            }
+            if (poll(descriptors.data(), descriptors.size(), static_cast<int>(wait)) < 0 && errno != EINTR) {
+                std::string error{std::strerror(errno)};
+                for (Connection& connection : active) {
+                    finish(connection, error);
+                }
+                active.clear();
+                break;
+            }
+
+            now = monotonicMilliseconds();
+            std::size_t kept{0};
+            for (std::size_t i = 0; i < active.size(); ++i) {
+                Connection& connection{active[i]};
+                std::string error;
+                bool done{false};
+                if (descriptors[i].revents != 0) {
+                    done = advance(connection, error);
+                }
+                if (!done && now >= connection.deadline) {
+                    error = "timed out";
+                    done = true;
+                }
+                if (done) {
+                    finish(connection, error);
+                } else if (kept != i) {
+                    active[kept++] = std::move(connection);
+                } else {
+                    ++kept;
+                }
+            }
+            active.erase(active.begin() + static_cast<std::ptrdiff_t>(kept), active.end());
+        }
+        return failures;
+    }
+
+private:
+    // One host being collected: a socket to a daemon, or the read end of ssh's stdout
+    struct Connection {
+        const FleetTarget* target;
+        int fd{-1};
+        pid_t pid{-1};          // ssh process, for ssh targets
+        std::size_t written{0}; // Bytes of `request` sent so far, for daemon targets
+        bool connected{false};
+        DaemonRequest request{};
+        OutputBuffer reply;
+        std::int64_t deadline{0};
+
+        explicit Connection(const FleetTarget* fleetTarget) : target{fleetTarget} {}
+        Connection(Connection&& other) noexcept { *this = std::move(other); }
+        Connection& operator=(Connection&& other) noexcept {
+            target = other.target;
+            fd = other.fd;
+            pid = other.pid;
+            written = other.written;
+            connected = other.connected;
+            request = other.request;
+            reply = std::move(other.reply);
+            deadline = other.deadline;
+            other.fd = -1;
+            other.pid = -1;
+            return *this;
+        }
+        ~Connection() { kill(); }
+
+        bool writing() const { return pid < 0 && written < sizeof(request); }
+
+        // Abort: close the descriptor and kill ssh
+        void kill() {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            if (pid > 0) {
+                ::kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                pid = -1;
+            }
+        }
+
+        // Normal end: close the descriptor and collect ssh's exit status; returns false (with a message) on failure
+        bool closeAndReap(std::string& error) {
+            if (fd >= 0) {
+                close(fd);
+                fd = -1;
+            }
+            if (pid <= 0) {
+                return true;
+            }
+            int status{0};
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            pid = -1;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                error = WIFEXITED(status) ? "ssh exited with status " + std::to_string(WEXITSTATUS(status))
+                                          : std::string{"ssh was killed"};
+                return false;
+            }
+            return true;
+        }
+    };
+
+    static std::int64_t monotonicMilliseconds() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<std::int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    }
+
+    bool start(Connection& connection, std::string& error) {
+        connection.deadline = monotonicMilliseconds() + options.timeoutMs;
+        if (connection.target->kind == FleetTarget::Kind::Ssh) {
+            return startSsh(connection, error);
+        }
+        connection.request = makeDaemonRequest(filter);
+        return connection.target->kind == FleetTarget::Kind::Unix ? startUnix(connection, error)
+                                                                  : startTcp(connection, error);
+    }
+
+    bool startUnix(Connection& connection, std::string& error) {
+        sockaddr_un address;
+        if (!makeUnixAddress(connection.target->host, address)) {
+            error = "socket path too long";
+            return false;
+        }
+        connection.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        return connectSocket(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address), error);
+    }
+
+    bool startTcp(Connection& connection, std::string& error) {
+#ifdef IFACEPICKER_STATIC
+        // getaddrinfo() would need glibc's NSS modules at run time, which a static binary cannot rely on
+        char* end{nullptr};
+        unsigned long port{std::strtoul(connection.target->port.c_str(), &end, 10)};
+        sockaddr_in6 address6{};
+        sockaddr_in address4{};
+        if (*end != '\0' || port == 0 || port > 65535) {
+            error = "invalid port: " + connection.target->port;
+            return false;
+        }
+        if (inet_pton(AF_INET, connection.target->host.c_str(), &address4.sin_addr) == 1) {
+            address4.sin_family = AF_INET;
+            address4.sin_port = htons(static_cast<std::uint16_t>(port));
+            connection.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            return connectSocket(connection, reinterpret_cast<const sockaddr*>(&address4), sizeof(address4), error);
+        }
+        if (inet_pton(AF_INET6, connection.target->host.c_str(), &address6.sin6_addr) == 1) {
+            address6.sin6_family = AF_INET6;
+            address6.sin6_port = htons(static_cast<std::uint16_t>(port));
+            connection.fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            return connectSocket(connection, reinterpret_cast<const sockaddr*>(&address6), sizeof(address6), error);
+        }
+        error = "the static build only connects to numeric addresses";
+        return false;
+#else
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* resolved{nullptr};
+        int status{getaddrinfo(connection.target->host.c_str(), connection.target->port.c_str(), &hints, &resolved)};
+        if (status != 0) {
+            error = gai_strerror(status);
+            return false;
+        }
+        connection.fd = socket(resolved->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        bool connecting{connectSocket(connection, resolved->ai_addr, resolved->ai_addrlen, error)};
+        freeaddrinfo(resolved);
+        return connecting;
+#endif
+    }
+
+    static bool connectSocket(Connection& connection, const sockaddr* address, socklen_t length, std::string& error) {
+        if (connection.fd < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        if (connect(connection.fd, address, length) == 0) {
+            connection.connected = true;
+        } else if (errno != EINPROGRESS) {
+            error = std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    // Start `ssh HOST ifacepicker --format=image [filters]` with its stdout in a pipe
+    bool startSsh(Connection& connection, std::string& error) {
+        std::string remote{options.remoteCommand + " --format=image"};
+        if (filter.family != AF_UNSPEC) {
+            remote += filter.family == AF_INET ? " --family inet" : " --family inet6";
+        }
+        if (filter.upOnly) {
+            remote += " --up-only";
+        }
+        if (filter.hasLinkType()) {
+            remote += " --type " + shellQuote(filter.linkType);
+        }
+        std::string connectTimeout{"ConnectTimeout=" + std::to_string((options.timeoutMs + 999) / 1000)};
+        const char* arguments[]{"ssh", "-n", "-o", "BatchMode=yes", "-o", connectTimeout.c_str(),
+                                "--", connection.target->host.c_str(), remote.c_str(), nullptr};
+
+        int output[2];
+        if (pipe2(output, O_CLOEXEC) < 0) {
+            error = std::strerror(errno);
+            return false;
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+        int status{posix_spawnp(&connection.pid, "ssh", &actions, nullptr, const_cast<char**>(arguments), environ)};
+        posix_spawn_file_actions_destroy(&actions);
+        close(output[1]);
+        if (status != 0) {
+            close(output[0]);
+            connection.pid = -1;
+            error = std::string{"cannot run ssh: "} + std::strerror(status);
+            return false;
+        }
+        connection.fd = output[0];
+        fcntl(connection.fd, F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    // Handle a poll() event; returns true when the connection is finished (`error` empty on success)
+    static bool advance(Connection& connection, std::string& error) {
+        if (connection.writing()) {
+            if (!connection.connected) {
+                int status{0};
+                socklen_t length{sizeof(status)};
+                getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &status, &length);
+                if (status != 0) {
+                    error = std::strerror(status);
+                    return true;
+                }
+                connection.connected = true;
+            }
+            const char* data{reinterpret_cast<const char*>(&connection.request)};
+            ssize_t sent{send(connection.fd, data + connection.written, sizeof(connection.request) - connection.written,
+                              MSG_NOSIGNAL)};
+            if (sent < 0 && errno != EAGAIN && errno != EINTR) {
+                error = std::strerror(errno);
+                return true;
+            }
+            connection.written += sent > 0 ? static_cast<std::size_t>(sent) : 0;
+            return false;
+        }
+
+        char buffer[65536];
+        for (;;) {
+            ssize_t length{read(connection.fd, buffer, sizeof(buffer))};
+            if (length > 0) {
+                connection.reply.append(buffer, static_cast<std::size_t>(length));
+                continue;
+            }
+            if (length == 0) {
+                return true;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                return false;
+            }
+            error = std::strerror(errno);
+            return true;
+        }
+    }
+
+    const InterfaceFilter& filter;
+    const FleetOptions& options;
+};
+
+/*
+ * Append the result of one host to `out`: the interface chosen by `selector` (every interface for Kind::Prompt).
+ * - table: Null if the host failed, with `error` telling why.
+ * Returns false if the host failed or nothing was selected; the reason is then also in `error`.
+ */
+inline bool appendHostResult(OutputBuffer& out, OutputFormat format, const FleetTarget& target,
+                             const InterfaceTable* table, std::string& error, const InterfaceSelector& selector,
+                             const AddressSelector& addressSelector) {
+    if (format == OutputFormat::Text) {
+        format = OutputFormat::Env;
+    }
+    std::size_t position{NO_INTERFACE};
+    if (table != nullptr && selector.kind != InterfaceSelector::Kind::Prompt) {
+        position = findInterface(*table, selector);
+        if (position == NO_INTERFACE) {
+            error = "no interface found for: " + describeSelector(selector);
+            table = nullptr;
+        }
+    }
+
+    switch (format) {
+    case OutputFormat::Json:
+        out += "{\"host\":";
+        appendJsonString(out, target.label);
+        if (table == nullptr) {
+            out += ",\"error\":";
+            appendJsonString(out, error);
+        } else if (position != NO_INTERFACE) {
+            out += ",\"interface\":";
+            appendInterface(out, format, *table, (*table)[position], addressSelector);
+        } else {
+            out += ",\"interfaces\":[";
+            for (std::size_t i = 0; i < table->size(); ++i) {
+                if (i > 0) {
+                    out += ',';
+                }
+                appendInterface(out, format, *table, (*table)[i], addressSelector);
+            }
+            out += ']';
+        }
+        out += "}\n";
+        break;
+    case OutputFormat::Tsv:
+    case OutputFormat::Nul:
+        for (std::size_t i = 0; table != nullptr && i < table->size(); ++i) {
+            if (position == NO_INTERFACE || position == i) {
+                out += target.label;
+                out += format == OutputFormat::Tsv ? '\t' : '\0';
+                appendInterface(out, format, *table, (*table)[i], addressSelector);
+            }
+        }
+        break;
+    default:
+        out += "HOST=";
+        out += target.label;
+        out += '\n';
+        if (table == nullptr) {
+            out += "ERROR=";
+            out += error;
+            out += '\n';
+        }
+        for (std::size_t i = 0; table != nullptr && i < table->size(); ++i) {
+            if (position == NO_INTERFACE || position == i) {
+                // An empty line between interfaces, as in a local listing (EnvFormat's LIST_SEPARATOR)
+                if (position == NO_INTERFACE && i > 0) {
+                    out += '\n';
+                }
+                appendInterface(out, format, *table, (*table)[i], addressSelector);
+            }
+        }
+        break;
+    }
+    return table != nullptr;
+}
+
+#endif // IFACEPICKER_FLEET_HPP
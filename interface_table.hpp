@@ -0,0 +1,448 @@
+/*
+ * interface_table.hpp - Compact storage for the enumerated interfaces.
+ *
+ * Each interface is a fixed-size record: the name in an IFNAMSIZ array, the kernel interface index and the range of
+ * its addresses in one flat address array shared by all interfaces. Addresses are kept in binary form
+ * (in_addr/in6_addr) with their family tag, so nothing is allocated per interface or per address, and addresses are
+ * only turned into text when they are printed. The arrays are allocated from the memory_resource the table is
+ * constructed with (the run's arena, see arena.hpp), which the backends also use for their scratch data.
+ * Attributes only some outputs need (MAC address, MTU, ...) are not part of the records: a backend may attach them to
+ * an interface as opaque bytes when asked to (keepLinkAttributes), for whoever prints it to decode (see fields.hpp).
+ */
+
+#ifndef IFACEPICKER_INTERFACE_TABLE_HPP
+#define IFACEPICKER_INTERFACE_TABLE_HPP
+
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+
+// Text shown for interfaces without a configured address
+constexpr const char* NO_IP_ADDRESS{"<no ip address>"};
+
+// Buffer large enough for any address formatted by formatAddress()
+constexpr std::size_t ADDRESS_TEXT_SIZE{INET6_ADDRSTRLEN};
+
+struct AddressRecord {
+    std::uint8_t family;       // AF_INET or AF_INET6
+    std::uint8_t prefixLength; // Network prefix length
+    std::uint8_t scope;        // RT_SCOPE_* value when known (0 = global)
+    union {
+        in_addr ipv4;
+        in6_addr ipv6;
+    } address;
+};
+
+struct InterfaceRecord {
+    char name[IFNAMSIZ];        // NUL-terminated interface name
+    int index;                  // Kernel interface index (0 if unknown)
+    unsigned int flags;         // IFF_* link flags
+    std::uint32_t firstAddress; // Start of this interface's range in the address array
+    std::uint32_t addressCount; // Number of addresses in the range
+
+    std::string_view nameView() const { return std::string_view{name}; }
+    bool hasAddress() const { return addressCount > 0; }
+
+    // Administratively up with carrier, and not a loopback device
+    bool isUp() const { return (flags & (IFF_UP | IFF_RUNNING | IFF_LOOPBACK)) == (IFF_UP | IFF_RUNNING); }
+};
+
+// The addresses of one interface: a slice of the table's flat address array
+struct AddressRange {
+    const AddressRecord* first;
+    const AddressRecord* last;
+
+    const AddressRecord* begin() const { return first; }
+    const AddressRecord* end() const { return last; }
+    std::size_t size() const { return static_cast<std::size_t>(last - first); }
+    bool empty() const { return first == last; }
+    const AddressRecord& operator[](std::size_t position) const { return first[position]; }
+};
+
+class InterfaceTable {
+public:
+    // Start of a table image (see appendImage)
+    struct ImageHeader {
+        std::uint32_t interfaceCount;
+        std::uint32_t addressCount;
+    };
+
+    explicit InterfaceTable(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : records{memory}, addressList{memory}, owners{memory}, linkAttributeData{memory},
+          linkAttributeRanges{memory} {}
+
+    // Where the table allocates; also meant for the scratch data of whoever fills it
+    std::pmr::memory_resource* resource() const { return records.get_allocator().resource(); }
+
+    void reserve(std::size_t count) { records.reserve(count); }
+
+    void clear() {
+        records.clear();
+        addressList.clear();
+        owners.clear();
+        linkAttributeData.clear();
+        linkAttributeRanges.clear();
+        grouped = true;
+    }
+
+    // Ask the backends to attach the link attributes they receive to each interface (see setLinkAttributes)
+    void keepLinkAttributes(bool keep = true) { keepingLinkAttributes = keep; }
+    bool keepsLinkAttributes() const { return keepingLinkAttributes; }
+
+    // Attach backend-specific link attributes, copied as they are, to the interface last added
+    void setLinkAttributes(const void* data, std::size_t size) {
+        if (records.empty()) {
+            return;
+        }
+        linkAttributeRanges.resize(records.size());
+        linkAttributeRanges.back() = {static_cast<std::uint32_t>(linkAttributeData.size()),
+                                      static_cast<std::uint32_t>(size)};
+        const char* bytes{static_cast<const char*>(data)};
+        linkAttributeData.insert(linkAttributeData.end(), bytes, bytes + size);
+    }
+
+    // Whether the backend attached link attributes to the interfaces
+    bool hasLinkAttributes() const { return !linkAttributeRanges.empty(); }
+
+    // Link attributes attached to an interface of this table; empty if the backend attached none
+    std::string_view linkAttributes(const InterfaceRecord& record) const {
+        std::size_t position{positionOf(record)};
+        if (position >= linkAttributeRanges.size()) {
+            return {};
+        }
+        const auto& range{linkAttributeRanges[position]};
+        return std::string_view{linkAttributeData.data() + range.first, range.second};
+    }
+
+    // Append an interface without addresses; names longer than IFNAMSIZ - 1 are truncated as the kernel would
+    InterfaceRecord& add(std::string_view name, int index, unsigned int flags = 0) {
+        InterfaceRecord& record{records.emplace_back()};
+        std::size_t length{name.size() < IFNAMSIZ ? name.size() : IFNAMSIZ - 1};
+        std::memcpy(record.name, name.data(), length);
+        record.name[length] = '\0';
+        record.index = index;
+        record.flags = flags;
+        record.firstAddress = 0;
+        record.addressCount = 0;
+        return record;
+    }
+
+    /*
+     * Add a binary address (in_addr or in6_addr, depending on the family) to the interface at `position`.
+     * Addresses may arrive in any interface order (e.g. all IPv4 addresses, then all IPv6 ones); finish() groups them
+     * by interface, keeping the order in which each interface's addresses were added.
+     */
+    void addAddress(std::size_t position, int family, const void* address, std::uint8_t prefixLength,
+                    std::uint8_t scope = 0) {
+        AddressRecord& entry{addressList.emplace_back()};
+        entry.family = static_cast<std::uint8_t>(family);
+        entry.prefixLength = prefixLength;
+        entry.scope = scope;
+        std::memcpy(&entry.address, address, family == AF_INET6 ? sizeof(in6_addr) : sizeof(in_addr));
+
+        if (!owners.empty() && position < owners.back()) {
+            grouped = false;
+        }
+        owners.push_back(static_cast<std::uint32_t>(position));
+    }
+
+    // Add an address given as text; returns false if the text is not a valid address of that family
+    bool addAddressText(std::size_t position, int family, std::string_view text, std::uint8_t prefixLength,
+                        std::uint8_t scope = 0) {
+        char address[ADDRESS_TEXT_SIZE];
+        if (text.size() >= sizeof(address)) {
+            return false;
+        }
+        std::memcpy(address, text.data(), text.size());
+        address[text.size()] = '\0';
+
+        in6_addr binary;
+        if (inet_pton(family, address, &binary) != 1) {
+            return false;
+        }
+        addAddress(position, family, &binary, prefixLength, scope);
+        return true;
+    }
+
+    /*
+     * Group the addresses by interface and set each record's range. Must be called once all addresses are added.
+     * When addresses arrived already grouped (the common case for text parsers) only the ranges are computed;
+     * otherwise a stable counting sort by interface position reorders the array in O(interfaces + addresses).
+     */
+    void finish() {
+        for (auto& record : records) {
+            record.addressCount = 0;
+        }
+        for (std::uint32_t owner : owners) {
+            ++records[owner].addressCount;
+        }
+
+        std::uint32_t offset{0};
+        for (auto& record : records) {
+            record.firstAddress = offset;
+            offset += record.addressCount;
+        }
+
+        if (!grouped) {
+            std::pmr::vector<AddressRecord> sorted(addressList.size(), resource());
+            std::pmr::vector<std::uint32_t> next(records.size(), resource());
+            for (std::size_t i = 0; i < records.size(); ++i) {
+                next[i] = records[i].firstAddress;
+            }
+            for (std::size_t i = 0; i < addressList.size(); ++i) {
+                sorted[next[owners[i]]++] = addressList[i];
+            }
+            addressList.swap(sorted);
+        }
+
+        owners.clear();
+        grouped = true;
+    }
+
+    AddressRange addresses(const InterfaceRecord& record) const {
+        const AddressRecord* first{addressList.data() + record.firstAddress};
+        return AddressRange{first, first + record.addressCount};
+    }
+
+    /*
+     * Append the table in its binary form: an ImageHeader, the interface records and the address records, copied
+     * as they are in memory. Used wherever a table leaves the process (e.g. the daemon's replies). The table must
+     * be finished.
+     */
+    void appendImage(OutputBuffer& out) const {
+        ImageHeader header{static_cast<std::uint32_t>(records.size()), static_cast<std::uint32_t>(addressList.size())};
+        out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(InterfaceRecord));
+        out.append(reinterpret_cast<const char*>(addressList.data()), addressList.size() * sizeof(AddressRecord));
+    }
+
+    // Replace the table with a binary image; returns false (leaving the table empty) if the image is inconsistent
+    bool loadImage(const char* data, std::size_t size) {
+        clear();
+        ImageHeader header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+        std::memcpy(&header, data, sizeof(header));
+        std::size_t recordBytes{static_cast<std::size_t>(header.interfaceCount) * sizeof(InterfaceRecord)};
+        std::size_t addressBytes{static_cast<std::size_t>(header.addressCount) * sizeof(AddressRecord)};
+        if (size != sizeof(header) + recordBytes + addressBytes) {
+            return false;
+        }
+
+        records.resize(header.interfaceCount);
+        addressList.resize(header.addressCount);
+        std::memcpy(records.data(), data + sizeof(header), recordBytes);
+        std::memcpy(addressList.data(), data + sizeof(header) + recordBytes, addressBytes);
+        for (auto& record : records) {
+            record.name[IFNAMSIZ - 1] = '\0';
+            if (record.firstAddress > header.addressCount ||
+                record.addressCount > header.addressCount - record.firstAddress) {
+                clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Size of the image appendImage() writes
+    std::size_t imageSize() const {
+        return sizeof(ImageHeader) + records.size() * sizeof(InterfaceRecord) +
+               addressList.size() * sizeof(AddressRecord);
+    }
+
+    std::size_t size() const { return records.size(); }
+    std::size_t addressTotal() const { return addressList.size(); }
+    bool empty() const { return records.empty(); }
+    InterfaceRecord& operator[](std::size_t position) { return records[position]; }
+    const InterfaceRecord& operator[](std::size_t position) const { return records[position]; }
+    // Position in this table of one of its records
+    std::size_t positionOf(const InterfaceRecord& record) const {
+        return static_cast<std::size_t>(&record - records.data());
+    }
+    auto begin() const { return records.begin(); }
+    auto end() const { return records.end(); }
+
+private:
+    std::pmr::vector<InterfaceRecord> records;
+    std::pmr::vector<AddressRecord> addressList;
+    std::pmr::vector<std::uint32_t> owners; // Interface position of each address, until finish()
+    bool grouped{true};                // True while addresses were added in interface order
+    bool keepingLinkAttributes{false};
+    std::pmr::vector<char> linkAttributeData; // Attached link attributes of every interface, back to back
+    std::pmr::vector<std::pair<std::uint32_t, std::uint32_t>> linkAttributeRanges; // Offset and size by position
+};
+
+/*
+ * Which of an interface's addresses to output.
+ * - Inet / Inet6 / Any: The first address of that family (Any: of either family).
+ * - Number: The N-th address of the interface, counting from 1 in the order reported by the backend.
+ * - All: Every address, separated by spaces.
+ */
+struct AddressSelector {
+    enum class Kind { Inet, Inet6, Any, Number, All };
+
+    Kind kind{Kind::Inet};
+    std::size_t number{0};
+    const AddressRange* addresses{nullptr}; // If set, selected from instead of the interface's (a route's source)
+};
+
+// Function to get the addresses a selector selects from for an interface
+inline AddressRange selectableAddresses(const InterfaceTable& interfaceList, const InterfaceRecord& record,
+                                        const AddressSelector& selector) {
+    return selector.addresses != nullptr ? *selector.addresses : interfaceList.addresses(record);
+}
+
+// Function to parse an address selector: inet, inet6, any, all or a 1-based number; returns false if invalid
+inline bool parseAddressSelector(const std::string& text, AddressSelector& selector) {
+    if (text == "inet") {
+        selector.kind = AddressSelector::Kind::Inet;
+    } else if (text == "inet6") {
+        selector.kind = AddressSelector::Kind::Inet6;
+    } else if (text == "any") {
+        selector.kind = AddressSelector::Kind::Any;
+    } else if (text == "all") {
+        selector.kind = AddressSelector::Kind::All;
+    } else {
+        char* end{nullptr};
+        unsigned long number{std::strtoul(text.c_str(), &end, 10)};
+        if (text.empty() || *end != '\0' || number == 0) {
+            return false;
+        }
+        selector.kind = AddressSelector::Kind::Number;
+        selector.number = number;
+    }
+    return true;
+}
+
+// Function to write an IPv4 address in dotted decimal; returns the end of the text
+inline char* formatInet(const std::uint8_t* bytes, char* text) {
+    for (int i = 0; i < 4; ++i) {
+        unsigned int value{bytes[i]};
+        if (i > 0) {
+            *text++ = '.';
+        }
+        if (value >= 100) {
+            *text++ = static_cast<char>('0' + value / 100);
+            value %= 100;
+            *text++ = static_cast<char>('0' + value / 10);
+        } else if (value >= 10) {
+            *text++ = static_cast<char>('0' + value / 10);
+        }
+        *text++ = static_cast<char>('0' + value % 10);
+    }
+    return text;
+}
+
+/*
+ * Write an IPv6 address as inet_ntop() does (RFC 5952): lowercase groups without leading zeros, the longest run of
+ * two or more zero groups (the first on a tie) shortened to "::", and IPv4-mapped and IPv4-compatible addresses ending
+ * in dotted decimal. Returns the end of the text.
+ */
+inline char* formatInet6(const std::uint8_t* bytes, char* text) {
+    constexpr const char* DIGITS{"0123456789abcdef"};
+    unsigned int groups[8];
+    int runStart{-1};
+    int runLength{0};
+    for (int i = 0, start = -1; i < 8; ++i) {
+        groups[i] = static_cast<unsigned int>(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+        if (groups[i] != 0) {
+            start = -1;
+        } else if (start < 0) {
+            start = i;
+        }
+        if (start >= 0 && i - start + 1 > runLength) {
+            runStart = start;
+            runLength = i - start + 1;
+        }
+    }
+    if (runLength < 2) {
+        runStart = -1;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        if (runStart >= 0 && i >= runStart && i < runStart + runLength) {
+            if (i == runStart) {
+                *text++ = ':';
+            }
+            continue;
+        }
+        if (i > 0) {
+            *text++ = ':';
+        }
+        if (i == 6 && runStart == 0 && (runLength == 6 || (runLength == 5 && groups[5] == 0xffff))) {
+            return formatInet(bytes + 12, text);
+        }
+        bool leading{true};
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            unsigned int digit{(groups[i] >> shift) & 0xf};
+            if (digit != 0 || !leading || shift == 0) {
+                *text++ = DIGITS[digit];
+                leading = false;
+            }
+        }
+    }
+    if (runStart >= 0 && runStart + runLength == 8) {
+        *text++ = ':';
+    }
+    return text;
+}
+
+/*
+ * Format an address for output, without going through inet_ntop() (which dominates the rendering of large tables).
+ * - buffer: At least ADDRESS_TEXT_SIZE bytes; returns buffer, NUL-terminated.
+ */
+inline const char* formatAddress(const AddressRecord& entry, char* buffer) {
+    const auto* bytes{reinterpret_cast<const std::uint8_t*>(&entry.address)};
+    *(entry.family == AF_INET6 ? formatInet6(bytes, buffer) : formatInet(bytes, buffer)) = '\0';
+    return buffer;
+}
+
+// Function to append the selected address(es) of an interface to `out`, or NO_IP_ADDRESS if none is selected
+inline void appendSelectedAddresses(OutputBuffer& out, AddressRange addresses, const AddressSelector& selector) {
+    char text[ADDRESS_TEXT_SIZE];
+    std::size_t length{out.size()};
+
+    switch (selector.kind) {
+    case AddressSelector::Kind::Number:
+        if (selector.number <= addresses.size()) {
+            out += formatAddress(addresses[selector.number - 1], text);
+        }
+        break;
+    case AddressSelector::Kind::All:
+        for (const AddressRecord& entry : addresses) {
+            if (out.size() != length) {
+                out += ' ';
+            }
+            out += formatAddress(entry, text);
+        }
+        break;
+    default:
+        for (const AddressRecord& entry : addresses) {
+            if (selector.kind == AddressSelector::Kind::Any ||
+                entry.family == (selector.kind == AddressSelector::Kind::Inet ? AF_INET : AF_INET6)) {
+                out += formatAddress(entry, text);
+                break;
+            }
+        }
+        break;
+    }
+
+    if (out.size() == length) {
+        out += NO_IP_ADDRESS;
+    }
+}
+
+#endif // IFACEPICKER_INTERFACE_TABLE_HPP
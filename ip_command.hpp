@@ -0,0 +1,594 @@
+/*
+ * ip_command.hpp - Interface enumeration by parsing the JSON output of iproute2's 'ip -j address show'.
+ *
+ * This is the slowest method (it spawns the 'ip' binary), kept for systems where neither netlink sockets nor
+ * getifaddrs()/ioctl() can be used from this process. 'ip' is started directly with posix_spawnp() and an explicit
+ * argv, without a shell in between, and a thread reaps it as soon as it exits while its output is still being parsed.
+ * Its JSON output (iproute2 4.13 and later) is an array with one self-contained object per interface, holding the
+ * flags and every address, so unlike the text of 'ip a' nothing is carried over from one line to the next.
+ *
+ * The output is read in large chunks straight from the pipe descriptor and split into the objects of that array,
+ * which are decoded in place: objects and the names/addresses found in them are std::string_view slices into the
+ * chunk buffer, so parsing itself performs no allocation and objects of any size are handled (the buffer grows when
+ * a single object does not fit).
+ */
+
+#ifndef IFACEPICKER_IP_COMMAND_HPP
+#define IFACEPICKER_IP_COMMAND_HPP
+
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/rtnetlink.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "console.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "timings.hpp"
+
+extern char** environ;
+
+// Size of each read from the pipe
+constexpr std::size_t IP_COMMAND_CHUNK_SIZE{65536};
+
+/*
+ * Splits a JSON array read from a file descriptor into its objects.
+ * next() returns each top-level object, braces included. The view points into the internal buffer and stays valid
+ * only until the following call to next(). Anything between the objects (the brackets, commas and white space) is
+ * skipped without being checked.
+ */
+class ChunkedJsonReader {
+public:
+    explicit ChunkedJsonReader(int descriptor, std::pmr::memory_resource* memory = std::pmr::get_default_resource(),
+                               std::size_t chunkSize = IP_COMMAND_CHUNK_SIZE)
+        : fd{descriptor}, buffer(chunkSize, memory) {}
+
+    bool next(std::string_view& object) {
+        for (;;) {
+            // Only the bytes not yet scanned are looked at, so a large object is never rescanned from its start
+            if (scan()) {
+                object = std::string_view{buffer.data() + begin, scanned - begin};
+                begin = scanned;
+                return true;
+            }
+            if (finished || !fill()) {
+                // An object cut short (e.g. 'ip' was killed) is dropped
+                return false;
+            }
+        }
+    }
+
+    // True if reading stopped because of an error rather than the end of the data
+    bool failed() const { return readError != 0; }
+
+private:
+    // Advance `scanned` to the end of the current object; returns false if it is not complete yet
+    bool scan() {
+        const char* data{buffer.data()};
+        while (scanned < end) {
+            if (inString) {
+                // The closing quote is searched with memchr(): it is the first one after an even number of backslashes
+                std::size_t start{scanned + (escaped ? 1 : 0)};
+                auto* quote{static_cast<const char*>(std::memchr(data + start, '"', end - start))};
+                std::size_t position{quote != nullptr ? static_cast<std::size_t>(quote - data) : end};
+                std::size_t backslashes{0};
+                while (position - backslashes > start && data[position - backslashes - 1] == '\\') {
+                    ++backslashes;
+                }
+                if (quote == nullptr) {
+                    // The string goes on in the next chunk
+                    escaped = backslashes % 2 != 0;
+                    scanned = end;
+                    return false;
+                }
+                scanned = position + 1;
+                escaped = false;
+                inString = backslashes % 2 != 0;
+                continue;
+            }
+
+            char c{data[scanned++]};
+            if (depth == 0) {
+                // Between two objects
+                if (c == '{') {
+                    begin = scanned - 1;
+                    depth = 1;
+                } else {
+                    begin = scanned;
+                }
+            } else if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                ++depth;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Read one more chunk, first moving the partial object to the start of the buffer (or growing it if needed)
+    bool fill() {
+        if (begin > 0) {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            scanned -= begin;
+            begin = 0;
+        }
+        if (end == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        ssize_t length;
+        do {
+            length = read(fd, buffer.data() + end, buffer.size() - end);
+        } while (length < 0 && errno == EINTR);
+
+        if (length <= 0) {
+            readError = length < 0 ? errno : 0;
+            finished = true;
+            return false;
+        }
+        end += static_cast<std::size_t>(length);
+        timings().count(Counter::BytesRead, static_cast<std::uint64_t>(length));
+        return true;
+    }
+
+    int fd;
+    std::pmr::vector<char> buffer;
+    std::size_t begin{0};   // Start of the current (partial) object
+    std::size_t scanned{0}; // Bytes before this offset have been scanned
+    std::size_t end{0};     // End of the valid data
+    int depth{0};           // Nesting depth of objects and arrays at `scanned`
+    bool inString{false};
+    bool escaped{false};    // Inside a string, the byte at `scanned` is escaped by a backslash
+    bool finished{false};
+    int readError{0};
+};
+
+/*
+ * Reads the values of a JSON text in place, for the objects 'ip -j' prints.
+ * Strings are returned undecoded (see decodeJsonString); each member or element handler must read or skip() its value.
+ * Every function returns false on malformed input.
+ */
+class JsonCursor {
+public:
+    explicit JsonCursor(std::string_view json) : text{json} {}
+
+    // Call member(key, cursor) for each member of an object
+    template <typename Member>
+    bool object(Member&& member) {
+        if (!consume('{')) {
+            return false;
+        }
+        if (consume('}')) {
+            return true;
+        }
+        do {
+            std::string_view key;
+            if (!string(key) || !consume(':') || !member(key, *this)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume('}');
+    }
+
+    // Call element(cursor) for each element of an array
+    template <typename Element>
+    bool array(Element&& element) {
+        if (!consume('[')) {
+            return false;
+        }
+        if (consume(']')) {
+            return true;
+        }
+        do {
+            if (!element(*this)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(']');
+    }
+
+    // The raw contents of a string, between its quotes
+    bool string(std::string_view& value) {
+        if (!consume('"')) {
+            return false;
+        }
+        std::size_t start{position};
+        for (;;) {
+            position = text.find('"', position);
+            if (position == std::string_view::npos) {
+                return false;
+            }
+            // The closing quote is the first one after an even number of backslashes
+            std::size_t backslashes{0};
+            while (position - backslashes > start && text[position - backslashes - 1] == '\\') {
+                ++backslashes;
+            }
+            if (backslashes % 2 == 0) {
+                break;
+            }
+            ++position;
+        }
+        value = text.substr(start, position++ - start);
+        return true;
+    }
+
+    // A non-negative integer
+    bool number(unsigned long& value) {
+        skipSpace();
+        std::size_t start{position};
+        value = 0;
+        for (; position < text.size() && text[position] >= '0' && text[position] <= '9'; ++position) {
+            value = value * 10 + static_cast<unsigned long>(text[position] - '0');
+        }
+        return position > start;
+    }
+
+    // Skip any value
+    bool skip() {
+        skipSpace();
+        if (position >= text.size()) {
+            return false;
+        }
+        switch (text[position]) {
+        case '{':
+            return object([](std::string_view, JsonCursor& cursor) { return cursor.skip(); });
+        case '[':
+            return array([](JsonCursor& cursor) { return cursor.skip(); });
+        case '"': {
+            std::string_view value;
+            return string(value);
+        }
+        default: {
+            // Number, true, false or null
+            std::size_t start{position};
+            while (position < text.size() && text[position] != ',' && text[position] != '}' && text[position] != ']') {
+                ++position;
+            }
+            return position > start;
+        }
+        }
+    }
+
+    // The text of the value starting here, which is skipped
+    bool raw(std::string_view& value) {
+        skipSpace();
+        std::size_t start{position};
+        if (!skip()) {
+            return false;
+        }
+        value = text.substr(start, position - start);
+        return true;
+    }
+
+private:
+    void skipSpace() {
+        while (position < text.size() &&
+               (text[position] == ' ' || text[position] == '\t' || text[position] == '\n' || text[position] == '\r')) {
+            ++position;
+        }
+    }
+
+    bool consume(char c) {
+        skipSpace();
+        if (position < text.size() && text[position] == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    std::string_view text;
+    std::size_t position{0};
+};
+
+/*
+ * Decode the escapes of a raw JSON string into `buffer` (of `size` bytes), returning the decoded text; strings
+ * without escapes are returned as they are. Text that does not fit is truncated.
+ */
+inline std::string_view decodeJsonString(std::string_view raw, char* buffer, std::size_t size) {
+    if (raw.find('\\') == std::string_view::npos) {
+        return raw;
+    }
+    std::size_t length{0};
+    auto put{[&](char c) {
+        if (length < size) {
+            buffer[length++] = c;
+        }
+    }};
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\' || i + 1 >= raw.size()) {
+            put(raw[i]);
+            continue;
+        }
+        char c{raw[++i]};
+        switch (c) {
+        case 'b':
+            put('\b');
+            break;
+        case 'f':
+            put('\f');
+            break;
+        case 'n':
+            put('\n');
+            break;
+        case 'r':
+            put('\r');
+            break;
+        case 't':
+            put('\t');
+            break;
+        case 'u': {
+            // Code points are written back as UTF-8; surrogate pairs do not occur in interface names
+            unsigned int code{0};
+            for (std::size_t j = 0; j < 4 && i + 1 < raw.size(); ++j) {
+                char digit{raw[++i]};
+                code = code * 16 + static_cast<unsigned int>(digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+            }
+            if (code < 0x80) {
+                put(static_cast<char>(code));
+            } else if (code < 0x800) {
+                put(static_cast<char>(0xc0 | (code >> 6)));
+                put(static_cast<char>(0x80 | (code & 0x3f)));
+            } else {
+                put(static_cast<char>(0xe0 | (code >> 12)));
+                put(static_cast<char>(0x80 | ((code >> 6) & 0x3f)));
+                put(static_cast<char>(0x80 | (code & 0x3f)));
+            }
+            break;
+        }
+        default:
+            // \" \\ and \/
+            put(c);
+            break;
+        }
+    }
+    return std::string_view{buffer, length};
+}
+
+// Function to convert one of the "flags" of an interface ("UP", "LOWER_UP", ...) to IFF_* flags
+inline unsigned int parseIpCommandFlag(std::string_view name) {
+    static constexpr std::pair<std::string_view, unsigned int> NAMES[]{
+        {"UP", IFF_UP},
+        {"BROADCAST", IFF_BROADCAST},
+        {"LOOPBACK", IFF_LOOPBACK},
+        {"POINTOPOINT", IFF_POINTOPOINT},
+        {"NOARP", IFF_NOARP},
+        {"PROMISC", IFF_PROMISC},
+        {"MULTICAST", IFF_MULTICAST},
+        // 'ip' shows carrier as LOWER_UP; the kernel sets IFF_RUNNING along with it
+        {"LOWER_UP", IFF_LOWER_UP | IFF_RUNNING},
+    };
+
+    for (const auto& entry : NAMES) {
+        if (name == entry.first) {
+            return entry.second;
+        }
+    }
+    return 0;
+}
+
+// Function to convert the "scope" of an address to its RT_SCOPE_* value ("global" and unknown names are 0)
+inline std::uint8_t parseIpCommandScope(std::string_view name) {
+    if (name == "host") {
+        return RT_SCOPE_HOST;
+    }
+    if (name == "link") {
+        return RT_SCOPE_LINK;
+    }
+    if (name == "site") {
+        return RT_SCOPE_SITE;
+    }
+    return RT_SCOPE_UNIVERSE;
+}
+
+/*
+ * Parse one interface object of 'ip -j address show', calling the handler for what it contains:
+ *   {"ifindex":4,"ifname":"eth0","flags":["UP",...],...,       handler.interface("eth0", 4, IFF_UP | ...)
+ *    "addr_info":[{"family":"inet","local":"192.0.2.2",        handler.address(AF_INET, "192.0.2.2", 24, 0)
+ *                  "prefixlen":24,"scope":"global",...},...]}
+ * The interface is always reported before its addresses, whatever the order of the members. Returns false if the
+ * object is malformed or has no name.
+ */
+template <typename Handler>
+bool parseIpCommandObject(std::string_view object, Handler& handler) {
+    unsigned long index{0};
+    unsigned int flags{0};
+    std::string_view name;
+    std::string_view addresses;
+    JsonCursor cursor{object};
+    bool parsed{cursor.object([&](std::string_view key, JsonCursor& value) {
+        if (key == "ifindex") {
+            return value.number(index);
+        }
+        if (key == "ifname") {
+            return value.string(name);
+        }
+        if (key == "flags") {
+            return value.array([&](JsonCursor& element) {
+                std::string_view flag;
+                if (!element.string(flag)) {
+                    return false;
+                }
+                flags |= parseIpCommandFlag(flag);
+                return true;
+            });
+        }
+        if (key == "addr_info") {
+            // Decoded once the interface itself has been reported
+            return value.raw(addresses);
+        }
+        return value.skip();
+    })};
+    if (!parsed || name.empty()) {
+        return false;
+    }
+
+    char decoded[IFNAMSIZ];
+    handler.interface(decodeJsonString(name, decoded, sizeof(decoded)), static_cast<int>(index), flags);
+    if (addresses.empty()) {
+        return true;
+    }
+
+    JsonCursor addressCursor{addresses};
+    return addressCursor.array([&](JsonCursor& element) {
+        std::string_view family;
+        std::string_view local;
+        std::string_view scope;
+        unsigned long prefixLength{0};
+        bool parsedAddress{element.object([&](std::string_view key, JsonCursor& value) {
+            if (key == "family") {
+                return value.string(family);
+            }
+            if (key == "local") {
+                return value.string(local);
+            }
+            if (key == "prefixlen") {
+                return value.number(prefixLength);
+            }
+            if (key == "scope") {
+                // A number when the scope has no name
+                return value.string(scope) || value.skip();
+            }
+            return value.skip();
+        })};
+        if (parsedAddress && (family == "inet" || family == "inet6") && !local.empty()) {
+            handler.address(family == "inet" ? AF_INET : AF_INET6, local, static_cast<unsigned int>(prefixLength),
+                            parseIpCommandScope(scope));
+        }
+        return parsedAddress;
+    });
+}
+
+/*
+ * Builds the interface table from parse events: each address belongs to the last interface reported.
+ * The text is converted to binary right away; the parser itself works on views. Interfaces rejected by the filter are
+ * never added, and neither are their addresses.
+ */
+struct IpCommandListBuilder {
+    InterfaceTable& interfaceList;
+    const InterfaceFilter& filter;
+    bool skipping{true}; // True while the addresses belong to a filtered out interface (or none yet)
+
+    void interface(std::string_view name, int index, unsigned int flags) {
+        skipping = !filter.acceptsFlags(flags);
+        if (!skipping) {
+            interfaceList.add(name, index, flags);
+        }
+    }
+
+    void address(int family, std::string_view address, unsigned int prefixLength, std::uint8_t scope) {
+        if (!skipping && filter.acceptsFamily(family)) {
+            interfaceList.addAddressText(interfaceList.size() - 1, family, address,
+                                         static_cast<std::uint8_t>(prefixLength), scope);
+        }
+    }
+};
+
+/*
+ * A command started without a shell, with its standard output on a pipe.
+ * A thread waits for the child as soon as it is started, so it is reaped the moment it exits, while its output is
+ * still being read; finish() collects the status. The destructor closes the pipe (a child still writing gets
+ * SIGPIPE) and waits as finish() does.
+ */
+class SpawnedCommand {
+public:
+    SpawnedCommand() = default;
+    SpawnedCommand(const SpawnedCommand&) = delete;
+    SpawnedCommand& operator=(const SpawnedCommand&) = delete;
+    ~SpawnedCommand() { finish(); }
+
+    // Start arguments[0], looked up in PATH; stdin and stderr are inherited. Returns false with errno set on failure
+    bool start(const char* const* arguments) {
+        int output[2];
+        if (pipe2(output, O_CLOEXEC) < 0) {
+            return false;
+        }
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, output[1], STDOUT_FILENO);
+        int status{posix_spawnp(&pid, arguments[0], &actions, nullptr, const_cast<char**>(arguments), environ)};
+        posix_spawn_file_actions_destroy(&actions);
+        close(output[1]);
+        if (status != 0) {
+            close(output[0]);
+            pid = -1;
+            errno = status;
+            return false;
+        }
+        fd = output[0];
+
+        reaper = std::thread{[this] {
+            while (waitpid(pid, &exitStatus, 0) < 0 && errno == EINTR) {
+            }
+        }};
+        return true;
+    }
+
+    // Read end of the child's standard output
+    int descriptor() const { return fd; }
+
+    // Close the pipe and wait for the child; returns true if it ran and exited with status 0
+    bool finish() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        if (reaper.joinable()) {
+            reaper.join();
+        }
+        return pid > 0 && WIFEXITED(exitStatus) && WEXITSTATUS(exitStatus) == 0;
+    }
+
+private:
+    pid_t pid{-1};
+    int fd{-1};
+    int exitStatus{0};
+    std::thread reaper;
+};
+
+// Function to fill the interface list by parsing the output of 'ip -j address show'
+inline bool enumerateWithIpCommand(InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    // Not "ip -4"/"ip -6" for a family filter: those leave out the interfaces without an address of that family
+    const char* arguments[]{"ip", "-j", "address", "show", nullptr};
+
+    TimedPhase openPhase{Phase::Open};
+    SpawnedCommand command;
+    bool started{command.start(arguments)};
+    openPhase.stop();
+    if (!started) {
+        errorMessage() << "Error starting command: ip: " << std::strerror(errno) << '\n';
+        return false;
+    }
+
+    ChunkedJsonReader reader{command.descriptor(), interfaceList.resource()};
+    IpCommandListBuilder builder{interfaceList, filter};
+    std::string_view object;
+    bool parsed{true};
+    while (parsed && reader.next(object)) {
+        timings().count(Counter::LinesRead);
+        parsed = parseIpCommandObject(object, builder);
+    }
+    interfaceList.finish();
+
+    // 'ip' fails, printing why on stderr, when it cannot list the interfaces or does not know -j (before 4.13)
+    bool succeeded{command.finish()};
+    return parsed && succeeded && !reader.failed();
+}
+
+#endif // IFACEPICKER_IP_COMMAND_HPP
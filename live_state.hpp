@@ -0,0 +1,310 @@
+/*
+ * live_state.hpp - An interface table kept up to date from rtnetlink notifications.
+ *
+ * InterfaceMonitor subscribes to the RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR and RTNLGRP_IPV6_IFADDR multicast groups,
+ * dumps links and addresses once, and then applies each notification to a LiveInterfaceState. The work per
+ * notification depends on the size of the change, not on the number of interfaces. Used by the daemon (daemon.hpp)
+ * and by watch mode (watch.hpp).
+ */
+
+#ifndef IFACEPICKER_LIVE_STATE_HPP
+#define IFACEPICKER_LIVE_STATE_HPP
+
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "console.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "netlink.hpp"
+
+// Size requested for the notification socket's receive buffer, so that bursts of changes do not overflow it
+constexpr int MONITOR_RECEIVE_BUFFER{4 * 1024 * 1024};
+
+// Function to compare two addresses by family, value and prefix length
+inline bool sameAddress(const AddressRecord& a, const AddressRecord& b) {
+    std::size_t size{a.family == AF_INET6 ? sizeof(in6_addr) : sizeof(in_addr)};
+    return a.family == b.family && a.prefixLength == b.prefixLength && std::memcmp(&a.address, &b.address, size) == 0;
+}
+
+// One link of a LiveInterfaceState, with its addresses
+struct LiveLink {
+    char name[IFNAMSIZ];
+    unsigned int flags;
+    unsigned short hardwareType;
+    char kind[16]; // IFLA_INFO_KIND, empty if none
+    std::vector<AddressRecord> addresses;
+};
+
+/*
+ * Callbacks for changes applied to a LiveInterfaceState.
+ * - linkChanged(): `before` is null for a new link, `after` is null for a removed one.
+ * - addressChanged(): An address was added to or removed from `link`.
+ */
+class LiveStateObserver {
+public:
+    virtual ~LiveStateObserver() = default;
+    virtual void linkChanged(int index, const LiveLink* before, const LiveLink* after) = 0;
+    virtual void addressChanged(int index, const LiveLink& link, const AddressRecord& entry, bool added) = 0;
+};
+
+/*
+ * A copy of the kernel's links and addresses, kept in ifindex order and updated one netlink message at a time.
+ * Tables for queries are cut from it on demand; the unfiltered one is cached until the next change.
+ */
+class LiveInterfaceState {
+public:
+    void clear() {
+        links.clear();
+        indexByName.clear();
+        changed();
+    }
+
+    // Receive a callback for every change applied from now on (nullptr to stop)
+    void setObserver(LiveStateObserver* newObserver) { observer = newObserver; }
+    LiveStateObserver* currentObserver() const { return observer; }
+
+    // Apply an RTM_NEWLINK/RTM_DELLINK/RTM_NEWADDR/RTM_DELADDR message, from a dump or a notification
+    void apply(const nlmsghdr* message) {
+        switch (message->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+            applyLink(message);
+            break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+            applyAddress(message);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /*
+     * Fill `interfaceList` with the interfaces matching the filter, or only the one called `name` if it is not empty.
+     * A name lookup costs O(1) in the number of interfaces.
+     */
+    void snapshot(const InterfaceFilter& filter, std::string_view name, InterfaceTable& interfaceList) const {
+        if (!name.empty()) {
+            auto index{indexByName.find(std::string{name})};
+            if (index != indexByName.end()) {
+                addLink(index->second, links.at(index->second), filter, interfaceList);
+            }
+        } else {
+            interfaceList.reserve(links.size());
+            for (const auto& entry : links) {
+                addLink(entry.first, entry.second, filter, interfaceList);
+            }
+        }
+        interfaceList.finish();
+    }
+
+    // Image of the unfiltered table, rebuilt only after the state changed
+    const OutputBuffer& fullImage() {
+        if (imageGeneration != currentGeneration) {
+            InterfaceTable interfaceList;
+            snapshot(InterfaceFilter{}, {}, interfaceList);
+            image.clear();
+            interfaceList.appendImage(image);
+            imageGeneration = currentGeneration;
+        }
+        return image;
+    }
+
+    // Incremented on every change
+    std::uint64_t generation() const { return currentGeneration; }
+    std::size_t size() const { return links.size(); }
+    const std::map<int, LiveLink>& linkMap() const { return links; }
+
+private:
+    void changed() { ++currentGeneration; }
+
+    void applyLink(const nlmsghdr* message) {
+        const auto* info{static_cast<const ifinfomsg*>(NLMSG_DATA(message))};
+        // RTNLGRP_LINK also carries AF_BRIDGE messages about bridge ports; a port leaving a bridge is still a link
+        if (info->ifi_family != AF_UNSPEC) {
+            return;
+        }
+        auto existing{links.find(info->ifi_index)};
+        if (existing != links.end()) {
+            indexByName.erase(existing->second.name);
+        }
+
+        if (message->nlmsg_type == RTM_DELLINK) {
+            if (existing != links.end()) {
+                if (observer != nullptr) {
+                    observer->linkChanged(info->ifi_index, &existing->second, nullptr);
+                }
+                links.erase(existing);
+                changed();
+            }
+            return;
+        }
+
+        // The observer needs the link as it was; the copy is only made when someone is watching
+        LiveLink before;
+        bool existed{existing != links.end()};
+        if (observer != nullptr && existed) {
+            before = existing->second;
+        }
+
+        const rtattr* attributes[IFLA_MAX + 1];
+        parseLinkAttributes(message, attributes);
+        LiveLink& link{links[info->ifi_index]};
+        if (attributes[IFLA_IFNAME] != nullptr) {
+            std::strncpy(link.name, static_cast<const char*>(RTA_DATA(attributes[IFLA_IFNAME])), IFNAMSIZ - 1);
+            link.name[IFNAMSIZ - 1] = '\0';
+        }
+        std::string_view kind{linkKind(attributes)};
+        std::size_t kindLength{kind.size() < sizeof(link.kind) ? kind.size() : sizeof(link.kind) - 1};
+        std::memcpy(link.kind, kind.data(), kindLength);
+        link.kind[kindLength] = '\0';
+        link.flags = info->ifi_flags;
+        link.hardwareType = info->ifi_type;
+        indexByName[link.name] = info->ifi_index;
+        changed();
+
+        if (observer != nullptr) {
+            observer->linkChanged(info->ifi_index, existed ? &before : nullptr, &link);
+        }
+    }
+
+    void applyAddress(const nlmsghdr* message) {
+        const auto* info{static_cast<const ifaddrmsg*>(NLMSG_DATA(message))};
+        auto link{links.find(static_cast<int>(info->ifa_index))};
+        if (link == links.end() || (info->ifa_family != AF_INET && info->ifa_family != AF_INET6)) {
+            return;
+        }
+
+        const rtattr* attributes[IFA_MAX + 1];
+        parseAddressAttributes(message, attributes);
+        const rtattr* address{attributes[IFA_LOCAL] ? attributes[IFA_LOCAL] : attributes[IFA_ADDRESS]};
+        if (address == nullptr) {
+            return;
+        }
+
+        AddressRecord entry{};
+        entry.family = info->ifa_family;
+        entry.prefixLength = info->ifa_prefixlen;
+        entry.scope = info->ifa_scope;
+        std::memcpy(&entry.address, RTA_DATA(address), info->ifa_family == AF_INET6 ? sizeof(in6_addr) : sizeof(in_addr));
+
+        // An address is identified by family, value and prefix; a new message for it replaces the old one
+        auto& addresses{link->second.addresses};
+        bool existed{false};
+        for (auto it = addresses.begin(); it != addresses.end(); ++it) {
+            if (sameAddress(*it, entry)) {
+                addresses.erase(it);
+                existed = true;
+                break;
+            }
+        }
+        bool added{message->nlmsg_type == RTM_NEWADDR};
+        if (added) {
+            addresses.push_back(entry);
+        }
+        changed();
+
+        // Refreshing an existing address (e.g. its lifetimes) is not a change as far as observers are concerned
+        if (observer != nullptr && added != existed) {
+            observer->addressChanged(link->first, link->second, entry, added);
+        }
+    }
+
+    static void addLink(int index, const LiveLink& link, const InterfaceFilter& filter, InterfaceTable& interfaceList) {
+        if (!filter.acceptsFlags(link.flags) || !filter.acceptsLinkType(link.kind, link.hardwareType)) {
+            return;
+        }
+        std::size_t position{interfaceList.size()};
+        interfaceList.add(link.name, index, link.flags);
+        for (const AddressRecord& entry : link.addresses) {
+            if (filter.acceptsFamily(entry.family)) {
+                interfaceList.addAddress(position, entry.family, &entry.address, entry.prefixLength, entry.scope);
+            }
+        }
+    }
+
+    std::map<int, LiveLink> links;
+    std::unordered_map<std::string, int> indexByName;
+    LiveStateObserver* observer{nullptr};
+    std::uint64_t currentGeneration{0};
+    std::uint64_t imageGeneration{static_cast<std::uint64_t>(-1)};
+    OutputBuffer image;
+};
+
+/*
+ * Owns the notification socket and the state it keeps up to date.
+ * - start(): Subscribes to the multicast groups, then loads the initial state.
+ * - applyNotifications(): Applies everything pending on descriptor() (call when poll() reports it readable).
+ * - resync(): Replaces the state with a fresh dump; done automatically when notifications were lost.
+ */
+class InterfaceMonitor {
+public:
+    bool start() {
+        // Subscribe before dumping, so that no change between the dump and the first notification is missed
+        if (!events.open() || !events.joinGroup(RTNLGRP_LINK) || !events.joinGroup(RTNLGRP_IPV4_IFADDR) ||
+            !events.joinGroup(RTNLGRP_IPV6_IFADDR)) {
+            errorMessage() << "Error subscribing to rtnetlink notifications: " << std::strerror(errno) << '\n';
+            return false;
+        }
+        setsockopt(events.descriptor(), SOL_SOCKET, SO_RCVBUF, &MONITOR_RECEIVE_BUFFER, sizeof(MONITOR_RECEIVE_BUFFER));
+
+        if (!resync()) {
+            errorMessage() << "Error reading the interfaces over rtnetlink" << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    // The observer is not called while the state is rebuilt
+    bool resync() {
+        LiveStateObserver* observer{liveState.currentObserver()};
+        liveState.setObserver(nullptr);
+
+        InterfaceFilter everything;
+        NetlinkRequest linkRequest{makeLinkDumpRequest(everything)};
+        NetlinkRequest addressRequest{makeAddressDumpRequest(everything)};
+        // Done again, on a new socket, with slots that fit if a datagram was too large for them
+        bool loaded{retryOnLargeDatagram([&]() {
+            liveState.clear();
+            NetlinkSocket socket;
+            return socket.open() && socket.send(linkRequest) &&
+                   socket.receive([&](const nlmsghdr* message) { liveState.apply(message); }) &&
+                   socket.send(addressRequest) &&
+                   socket.receive([&](const nlmsghdr* message) { liveState.apply(message); });
+        })};
+        liveState.setObserver(observer);
+        return loaded;
+    }
+
+    /*
+     * Apply all pending notifications. Returns false if some were lost (dropped by the kernel, or too large for the
+     * buffer) and the state had to be dumped again; observers are not told about what changed in that case.
+     */
+    bool applyNotifications() {
+        while (events.receiveEvents([&](const nlmsghdr* message) { liveState.apply(message); })) {
+        }
+        if (events.error() == ENOBUFS) {
+            resync();
+            return false;
+        }
+        return true;
+    }
+
+    int descriptor() const { return events.descriptor(); }
+    LiveInterfaceState& state() { return liveState; }
+
+private:
+    NetlinkSocket events;
+    LiveInterfaceState liveState;
+};
+
+#endif // IFACEPICKER_LIVE_STATE_HPP
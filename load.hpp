@@ -0,0 +1,237 @@
+/*
+ * load.hpp - Traffic rates sampled from the kernel's interface counters (--least-loaded).
+ *
+ * Two snapshots of the 64-bit counters of every interface (struct rtnl_link_stats64) are taken a short interval apart,
+ * each with a single RTM_GETSTATS dump that asks only for IFLA_STATS_LINK_64 (kernels before 4.7 lack RTM_GETSTATS;
+ * a RTM_GETLINK dump, whose IFLA_STATS64 attribute carries the same counters, is used there). Nothing is read from the
+ * per-interface statistics files of sysfs. The rates are per second, over the time actually elapsed between the dumps,
+ * and are matched to the table by interface index.
+ *
+ * --least-loaded selects the interface with the lowest utilisation: the busier direction's bit rate relative to the
+ * link speed. Only interfaces that are up with carrier are candidates; those without a known speed (most virtual
+ * devices) rank after the others, by byte rate.
+ */
+
+#ifndef IFACEPICKER_LOAD_HPP
+#define IFACEPICKER_LOAD_HPP
+
+#include <linux/if_link.h>
+#include <linux/rtnetlink.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <unordered_map>
+
+#include "interface_table.hpp"
+#include "netlink.hpp"
+#include "sysfs.hpp"
+#include "timings.hpp"
+
+// Sampling interval of --least-loaded and of the rate fields, in milliseconds, unless one is given
+constexpr long LOAD_INTERVAL_MS{200};
+constexpr long LOAD_INTERVAL_MAX_MS{60000};
+
+// Rates of one interface, per second
+struct LinkRates {
+    double rxBytes;
+    double txBytes;
+    double rxPackets;
+    double txPackets;
+    long speed; // Link speed in Mb/s, SYSFS_UNKNOWN until looked up (see LinkLoad::utilisation)
+};
+
+// Function to parse an interval: milliseconds, or a number followed by "ms" or "s"; returns false if out of range
+inline bool parseLoadInterval(const std::string& text, long& milliseconds) {
+    char* end{nullptr};
+    double value{std::strtod(text.c_str(), &end)};
+    if (end == text.c_str()) {
+        return false;
+    }
+    std::string unit{end};
+    if (unit == "s") {
+        value *= 1000;
+    } else if (!unit.empty() && unit != "ms") {
+        return false;
+    }
+    if (!(value >= 1 && value <= LOAD_INTERVAL_MAX_MS)) {
+        return false;
+    }
+    milliseconds = static_cast<long>(value);
+    return true;
+}
+
+class LinkLoad {
+public:
+    explicit LinkLoad(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : memory{memory}, rateByIndex{memory} {}
+
+    /*
+     * Take the two snapshots `intervalMs` apart and compute the rates. Returns false if the counters could not be
+     * dumped; interfaces created between the snapshots have no rates.
+     */
+    bool sample(long intervalMs) {
+        std::pmr::unordered_map<int, rtnl_link_stats64> first{memory};
+        std::int64_t firstTime;
+        if (!retryOnLargeDatagram([&]() { return dump(first, firstTime); })) {
+            return false;
+        }
+
+        timespec interval{intervalMs / 1000, (intervalMs % 1000) * 1000000};
+        while (nanosleep(&interval, &interval) != 0 && errno == EINTR) {
+        }
+
+        std::pmr::unordered_map<int, rtnl_link_stats64> second{memory};
+        std::int64_t secondTime;
+        if (!retryOnLargeDatagram([&]() { return dump(second, secondTime); })) {
+            return false;
+        }
+
+        double seconds{static_cast<double>(secondTime - firstTime) / 1e9};
+        rateByIndex.clear();
+        for (const auto& [index, after] : second) {
+            auto before{first.find(index)};
+            if (before == first.end()) {
+                continue;
+            }
+            // Counters that went backwards were reset (e.g. a driver reload): no traffic is known
+            auto rate{[&](std::uint64_t from, std::uint64_t to) {
+                return to >= from && seconds > 0 ? static_cast<double>(to - from) / seconds : 0.0;
+            }};
+            rateByIndex.emplace(index, LinkRates{rate(before->second.rx_bytes, after.rx_bytes),
+                                                 rate(before->second.tx_bytes, after.tx_bytes),
+                                                 rate(before->second.rx_packets, after.rx_packets),
+                                                 rate(before->second.tx_packets, after.tx_packets), SYSFS_UNKNOWN});
+        }
+        return true;
+    }
+
+    // Rates of the interface with this index, or null if it was not sampled
+    const LinkRates* rates(int index) const {
+        auto found{rateByIndex.find(index)};
+        return found == rateByIndex.end() ? nullptr : &found->second;
+    }
+
+    /*
+     * Utilisation of an interface, as a fraction of its link speed, of the busier direction; negative if unknown.
+     * The speed is read from sysfs on first use.
+     */
+    double utilisation(const InterfaceRecord& record) {
+        auto found{rateByIndex.find(record.index)};
+        if (found == rateByIndex.end()) {
+            return -1;
+        }
+        LinkRates& rates{found->second};
+        if (rates.speed == SYSFS_UNKNOWN) {
+            rates.speed = readLinkSpeed(record.name);
+            if (rates.speed == SYSFS_UNKNOWN) {
+                return -1;
+            }
+        }
+        double busier{rates.rxBytes > rates.txBytes ? rates.rxBytes : rates.txBytes};
+        return busier * 8 / (static_cast<double>(rates.speed) * 1e6);
+    }
+
+    /*
+     * Find the least loaded interface that is up with carrier: the lowest utilisation among those with a known link
+     * speed, else the lowest byte rate; the first listed on a tie. Returns its kernel index, or 0 if there is none.
+     */
+    int leastLoaded(const InterfaceTable& interfaceList) {
+        int best{0};
+        bool bestHasSpeed{false};
+        double bestLoad{0};
+        for (const InterfaceRecord& record : interfaceList) {
+            const LinkRates* sampled{rates(record.index)};
+            if (!record.isUp() || sampled == nullptr) {
+                continue;
+            }
+            double load{utilisation(record)};
+            bool hasSpeed{load >= 0};
+            if (!hasSpeed) {
+                load = sampled->rxBytes + sampled->txBytes;
+            }
+            if (best == 0 || (hasSpeed && !bestHasSpeed) || (hasSpeed == bestHasSpeed && load < bestLoad)) {
+                best = record.index;
+                bestHasSpeed = hasSpeed;
+                bestLoad = load;
+            }
+        }
+        return best;
+    }
+
+private:
+    // Function to dump the counters of every interface into `counters`, on a socket of its own, noting when the dump
+    // completed
+    bool dump(std::pmr::unordered_map<int, rtnl_link_stats64>& counters, std::int64_t& time) {
+        NetlinkSocket socket{memory};
+        if (!socket.open()) {
+            return false;
+        }
+        counters.clear();
+        if (useStats) {
+            if_stats_msg info{};
+            info.family = AF_UNSPEC;
+            info.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+            NetlinkRequest request{RTM_GETSTATS, NLM_F_REQUEST | NLM_F_DUMP, &info, sizeof(info)};
+            bool received{socket.send(request) && socket.receive([&](const nlmsghdr* message) {
+                if (message->nlmsg_type != RTM_NEWSTATS) {
+                    return;
+                }
+                const auto* reply{static_cast<const if_stats_msg*>(NLMSG_DATA(message))};
+                const rtattr* attributes[IFLA_STATS_MAX + 1];
+                parseAttributes(reinterpret_cast<const rtattr*>(reinterpret_cast<const char*>(reply) +
+                                                                NLMSG_ALIGN(sizeof(*reply))),
+                                static_cast<int>(message->nlmsg_len - NLMSG_LENGTH(NLMSG_ALIGN(sizeof(*reply)))),
+                                attributes, IFLA_STATS_MAX);
+                store(counters, static_cast<int>(reply->ifindex), attributes[IFLA_STATS_LINK_64]);
+            })};
+            if (received) {
+                time = monotonicNanoseconds();
+                return true;
+            }
+            if (socket.error() != EINVAL && socket.error() != EOPNOTSUPP) {
+                return false;
+            }
+            // No RTM_GETSTATS (before Linux 4.7)
+            useStats = false;
+            counters.clear();
+        }
+
+        ifinfomsg info{};
+        info.ifi_family = AF_UNSPEC;
+        NetlinkRequest request{RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP, &info, sizeof(info)};
+        bool received{socket.send(request) && socket.receive([&](const nlmsghdr* message) {
+            if (message->nlmsg_type != RTM_NEWLINK) {
+                return;
+            }
+            const rtattr* attributes[IFLA_MAX + 1];
+            parseLinkAttributes(message, attributes);
+            store(counters, static_cast<const ifinfomsg*>(NLMSG_DATA(message))->ifi_index, attributes[IFLA_STATS64]);
+        })};
+        time = monotonicNanoseconds();
+        return received;
+    }
+
+    static void store(std::pmr::unordered_map<int, rtnl_link_stats64>& counters, int index, const rtattr* attribute) {
+        // The structure grows with the kernel; the packet and byte counters are its first members
+        constexpr std::size_t NEEDED{offsetof(rtnl_link_stats64, tx_bytes) + sizeof(std::uint64_t)};
+        if (attribute == nullptr || RTA_PAYLOAD(attribute) < NEEDED) {
+            return;
+        }
+        rtnl_link_stats64 stats{};
+        std::memcpy(&stats, RTA_DATA(attribute), std::min<std::size_t>(RTA_PAYLOAD(attribute), sizeof(stats)));
+        counters[index] = stats;
+    }
+
+    std::pmr::memory_resource* memory;
+    std::pmr::unordered_map<int, LinkRates> rateByIndex;
+    bool useStats{true}; // Whether RTM_GETSTATS is supported
+};
+
+#endif // IFACEPICKER_LOAD_HPP
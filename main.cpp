@@ -1,158 +1,685 @@
 /*
- * ifacepicker - A C++ program for easy listing and selection of network interfaces and IP addresses using 'ip a'.
+ * ifacepicker - A C++ program for easy listing and selection of network interfaces and IP addresses.
  * Lucas Araujo - 2023-12-15
  *
  * Purpose:
  *   `ifacepicker` simplifies the process of selecting a network interface or IP address, aiding in scripting scenarios.
  *   It enhances visibility across interfaces, making it useful for various tasks, such as configuring Wake-on-LAN.
+ *   Interfaces are read directly from the kernel over rtnetlink, falling back to parsing 'ip -j' when netlink sockets
+ *   are not available.
  *
  * Compilation: g++ main.cpp -o ifacepicker
  */
 
-#include <iostream>
+#include <cstdlib>
 #include <limits>
+#include <new>
 #include <memory>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "arena.hpp"
+#include "backend.hpp"
+#include "batch.hpp"
+#include "console.hpp"
+#include "fields.hpp"
+#include "load.hpp"
+#include "fleet.hpp"
+#include "netns.hpp"
+#include "output.hpp"
+#include "selector.hpp"
+#include "sysfs_batch.hpp"
+#include "table_cache.hpp"
+#include "timings.hpp"
+#include "tui.hpp"
+#include "watch.hpp"
+
+// Failed allocations throw std::bad_alloc, or abort in builds without exceptions (make static)
+[[noreturn]] void allocationFailed() {
+#if defined(__cpp_exceptions)
+    throw std::bad_alloc{};
+#else
+    std::abort();
+#endif
+}
+
+// Every allocation of the program goes through these, so that --timings can count them
+void* operator new(std::size_t size) {
+    timings().count(Counter::Allocations);
+    timings().count(Counter::AllocatedBytes, size);
+    if (void* pointer{std::malloc(size != 0 ? size : 1)}) {
+        return pointer;
+    }
+    allocationFailed();
+}
+
+// Not inlined: GCC would otherwise see free() applied to the result of operator new and warn about a mismatch
+__attribute__((noinline)) void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+
+// Over-aligned allocations, such as the heap blocks of the arena (see arena.hpp)
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    timings().count(Counter::Allocations);
+    timings().count(Counter::AllocatedBytes, size);
+    auto boundary{static_cast<std::size_t>(alignment)};
+    if (void* pointer{std::aligned_alloc(boundary, (size + boundary - 1) / boundary * boundary)}) {
+        return pointer;
+    }
+    allocationFailed();
+}
+
+__attribute__((noinline)) void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+
+__attribute__((noinline)) void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept {
+    std::free(pointer);
+}
+
 // Function to display the help message
-void showHelp(const std::string& programName) {
-    std::ostringstream helpMessage;
-    helpMessage << "Usage: " << programName << " [-h|--help]" << std::endl;
-    helpMessage << "\nList and easily select network interfaces, displaying their respective IP addresses." << std::endl;
-    helpMessage << "\nOutput:" << std::endl;
-    helpMessage << "  IFACE=<interface-name>" << std::endl;
-    helpMessage << "  IPADDR=<configured-ip>" << std::endl;
-    helpMessage << "\nArguments:" << std::endl;
-    helpMessage << "  -h, --help   Show this help message" << std::endl;
-
-    std::cout << helpMessage.str();
+void showHelp(std::string_view programName) {
+    ConsoleMessage helpMessage{STDOUT_FILENO};
+    helpMessage << "Usage: " << programName << " [-h|--help] [--backend=NAME] [--address=SELECTOR]" << '\n';
+    helpMessage << "       " << std::string(programName.size(), ' ')
+                << " [--format=FORMAT] [--all-netns] [--family FAMILY] [--up-only] [--type TYPE]" << '\n';
+    helpMessage << "       " << std::string(programName.size(), ' ')
+                << " [--iface NAME | --index N | --first-up | --match GLOB | --route-to ADDR]" << '\n';
+    helpMessage << "       " << programName << " --batch [options] [SELECTOR...]" << '\n';
+    helpMessage << "       " << programName
+                << " --hosts FILE [--parallel N] [--timeout MS] [--remote-command CMD] [options]" << '\n';
+    helpMessage << "       " << programName << " --daemon [--socket PATH] [--snapshot PATH]" << '\n';
+    helpMessage << "       " << programName << " --watch [--iface NAME | --match GLOB] [filters]" << '\n';
+    helpMessage << "\nList and easily select network interfaces, displaying their respective IP addresses." << '\n';
+    helpMessage << "\nOutput:" << '\n';
+    helpMessage << "  IFACE=<interface-name>" << '\n';
+    helpMessage << "  IPADDR=<configured-ip>" << '\n';
+    helpMessage << "\nArguments:" << '\n';
+    helpMessage << "  -h, --help       Show this help message" << '\n';
+    helpMessage << "  --backend=NAME   How interfaces are enumerated: auto (default), snapshot, daemon, netlink,"
+                << '\n';
+    helpMessage << "                   getifaddrs, ioctl or ip. 'auto' uses the fastest one available in the current"
+                << '\n';
+    helpMessage << "                   environment" << '\n';
+    helpMessage << "  --address=SEL    Which address to show: inet (first IPv4, default), inet6 (first IPv6), any," << '\n';
+    helpMessage << "                   all (space separated) or N (the N-th address of the interface)" << '\n';
+    helpMessage << "  --format=FORMAT  Output format: text (default), env, json, tsv, nul or image (binary table read by"
+                << '\n';
+    helpMessage << "                   --hosts). Without a selection, every"
+                << '\n';
+    helpMessage << "                   interface is printed in that format instead of prompting" << '\n';
+    helpMessage << "  --fields=LIST    Fields to output, in order: name, index, ip, mac, mtu, operstate, speed (Mb/s),"
+                << '\n';
+    helpMessage << "                   e.g. --fields name,ip,mac; attributes are only looked up for what is printed"
+                << '\n';
+    helpMessage << "  --daemon         Keep the interface table up to date in memory and answer queries on a Unix socket"
+                << '\n';
+    helpMessage << "  --socket PATH    Socket of the daemon (default: " << DAEMON_SOCKET_PATH
+                << ", or $IFACEPICKER_SOCKET)" << '\n';
+    helpMessage << "  --snapshot PATH  Shared-memory snapshot published by the daemon (default: " << SNAPSHOT_PATH
+                << "," << '\n';
+    helpMessage << "                   or $IFACEPICKER_SNAPSHOT)" << '\n';
+    helpMessage << "  --cache PATH     Keep the table of a full listing in this file and reuse it while no interface or"
+                << '\n';
+    helpMessage << "                   address changed (or $IFACEPICKER_CACHE; auto backend only)" << '\n';
+    helpMessage << "  --cache-max-age MS" << '\n';
+    helpMessage << "                   Longest a cache file is reused, as up/down changes are not detected (default: "
+                << CACHE_MAX_AGE_MS << ")" << '\n';
+    helpMessage << "  --watch          Print the interfaces, then a +IFACE=/-IFACE= line for every change until"
+                << '\n';
+    helpMessage << "                   interrupted" << '\n';
+    helpMessage << "  --all-netns      List the interfaces of every network namespace (/run/netns and those of running"
+                << '\n';
+    helpMessage << "                   processes), tagged with NETNS=; needs CAP_SYS_ADMIN and the netlink backend"
+                << '\n';
+    helpMessage << "  --tui            Pick the interface in a full-screen list with type-to-filter search, drawn on"
+                << '\n';
+    helpMessage << "                   the terminal; only the result goes to stdout" << '\n';
+    helpMessage << "  --timings[=json] Report the duration of each phase and the bytes, lines, allocations... of the run"
+                << '\n';
+    helpMessage << "                   on stderr, as key=value pairs or one JSON object" << '\n';
+    helpMessage << "\nFilters:" << '\n';
+    helpMessage << "  --family FAMILY  Only addresses of this family: inet or inet6" << '\n';
+    helpMessage << "  --up-only        Only interfaces that are up with carrier (loopback excluded)" << '\n';
+    helpMessage << "  --type TYPE      Only interfaces of this link type: ether (plain Ethernet) or a link kind such"
+                << '\n';
+    helpMessage << "                   as veth, bond, bridge or vlan (netlink backend only)" << '\n';
+    helpMessage << "\nSelection (skips the list and the prompt):" << '\n';
+    helpMessage << "  --iface NAME     The interface with this name" << '\n';
+    helpMessage << "  --index N        The N-th interface of the list" << '\n';
+    helpMessage << "  --first-up       The first interface that is up with carrier (loopback excluded)" << '\n';
+    helpMessage << "  --match GLOB     The first interface whose name matches GLOB, e.g. 'eth*'" << '\n';
+    helpMessage << "  --route-to ADDR  The interface the kernel would use to reach ADDR; IPADDR is the preferred source"
+                << '\n';
+    helpMessage << "                   address of that route (netlink backend only)" << '\n';
+    helpMessage << "  --numa-local[=NODE]  The fastest interface attached to this CPU's NUMA node, or to NODE"
+                << '\n';
+    helpMessage << "  --least-loaded[=INTERVAL]  The interface with the lowest utilisation of its link speed, sampled"
+                << '\n';
+    helpMessage << "                   over INTERVAL (default: " << LOAD_INTERVAL_MS << "ms)" << '\n';
+    helpMessage << "  --owner-of ADDR[/PREFIX]  The interface configured with ADDR, or on the longest network containing"
+                << '\n';
+    helpMessage << "                   it (with /PREFIX: containing that whole prefix)" << '\n';
+    helpMessage << "\nFleet mode (many hosts at once, results streamed as each host finishes):" << '\n';
+    helpMessage << "  --hosts FILE     Collect every host of FILE, one per line: an ssh destination, unix:PATH or"
+                << '\n';
+    helpMessage << "                   tcp:HOST:PORT (an ifacepicker daemon socket)" << '\n';
+    helpMessage << "  --parallel N     Connections open at the same time (default: " << FLEET_PARALLEL << ")"
+                << '\n';
+    helpMessage << "  --timeout MS     Time allowed per host (default: " << FLEET_TIMEOUT_MS << ")" << '\n';
+    helpMessage << "  --remote-command CMD  ifacepicker on the ssh hosts (default: " << FLEET_REMOTE_COMMAND << ")"
+                << '\n';
+    helpMessage << "\nBatch mode (one enumeration, one result block per selector):" << '\n';
+    helpMessage << "  --batch          Answer each SELECTOR argument, or each line of stdin if there are none. A selector"
+                << '\n';
+    helpMessage << "                   is an interface name, a glob, a position in the list, a route destination"
+                << '\n';
+    helpMessage << "                   address or an ADDR/PREFIX owned address (as --owner-of)" << '\n';
+
+    helpMessage.flush();
+}
+
+// Function to match an option given as "--name=VALUE" or "--name VALUE" (consuming the next argument)
+bool matchOption(std::string_view arg, const char* name, int argc, char* argv[], int& i, std::string& value) {
+    std::size_t length{std::char_traits<char>::length(name)};
+    if (arg.compare(0, length, name) != 0) {
+        return false;
+    }
+    if (arg.size() > length && arg[length] == '=') {
+        value = arg.substr(length + 1);
+        return true;
+    }
+    if (arg.size() == length && i + 1 < argc) {
+        value = argv[++i];
+        return true;
+    }
+    return false;
 }
 
 int main(int argc, char* argv[]) {
     // Extract the program name from the full path
-    std::string programName = argv[0];
+    std::string_view programName = argv[0];
     size_t lastSlash = programName.find_last_of('/');
     if (lastSlash != std::string::npos) {
         programName = programName.substr(lastSlash + 1);
     }
 
-    // Check for help option
-    if (argc == 2) {
-        std::string arg = argv[1];
+    // Parse the command line options
+    Backend backend{Backend::Auto};
+    AddressSelector addressSelector;
+    bool addressSelectorGiven{false};
+    InterfaceFilter filter;
+    bool daemonMode{false};
+    bool watchMode{false};
+    OutputFormat outputFormat{OutputFormat::Text};
+    FieldTemplate fields;
+    long loadInterval{LOAD_INTERVAL_MS};
+    bool batchMode{false};
+    std::vector<std::string> batchArguments;
+    bool allNamespaces{false};
+    bool tuiMode{false};
+    std::string hostsFile;
+    FleetOptions fleetOptions;
+    InterfaceSelector interfaceSelector;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg{argv[i]};
+        std::string value;
         if (arg == "-h" || arg == "--help") {
             showHelp(programName);
             return 0;
+        } else if (matchOption(arg, "--backend", argc, argv, i, value)) {
+            if (!parseBackend(value, backend)) {
+                errorMessage() << "Unknown backend: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--address", argc, argv, i, value)) {
+            if (!parseAddressSelector(value, addressSelector)) {
+                errorMessage() << "Invalid address selector: " << value << '\n';
+                return 1;
+            }
+            addressSelectorGiven = true;
+        } else if (matchOption(arg, "--format", argc, argv, i, value)) {
+            if (!parseOutputFormat(value, outputFormat)) {
+                errorMessage() << "Unknown output format: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--fields", argc, argv, i, value)) {
+            std::string unknown;
+            if (!fields.parse(value, unknown)) {
+                errorMessage() << "Unknown field: " << unknown << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--family", argc, argv, i, value)) {
+            if (!parseFamilyFilter(value, filter)) {
+                errorMessage() << "Unknown address family: " << value << '\n';
+                return 1;
+            }
+        } else if (arg == "--daemon") {
+            daemonMode = true;
+        } else if (arg == "--batch") {
+            batchMode = true;
+        } else if (batchMode && !arg.empty() && arg[0] != '-') {
+            batchArguments.emplace_back(arg);
+        } else if (arg == "--watch") {
+            watchMode = true;
+        } else if (matchOption(arg, "--socket", argc, argv, i, value)) {
+            daemonSocketPath() = value;
+        } else if (matchOption(arg, "--snapshot", argc, argv, i, value)) {
+            snapshotPath() = value;
+        } else if (matchOption(arg, "--cache", argc, argv, i, value)) {
+            cachePath() = value;
+        } else if (matchOption(arg, "--cache-max-age", argc, argv, i, value)) {
+            cacheMaxAge() = std::atol(value.c_str());
+            if (cacheMaxAge() <= 0) {
+                errorMessage() << "Invalid cache age: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--hosts", argc, argv, i, value)) {
+            hostsFile = value;
+        } else if (matchOption(arg, "--parallel", argc, argv, i, value)) {
+            fleetOptions.parallel = std::strtoul(value.c_str(), nullptr, 10);
+            if (fleetOptions.parallel == 0) {
+                errorMessage() << "Invalid number of connections: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--timeout", argc, argv, i, value)) {
+            fleetOptions.timeoutMs = std::atoi(value.c_str());
+            if (fleetOptions.timeoutMs <= 0) {
+                errorMessage() << "Invalid timeout: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--remote-command", argc, argv, i, value)) {
+            fleetOptions.remoteCommand = value;
+        } else if (arg == "--timings" || arg == "--timings=kv") {
+            // No "--timings VALUE" form: the next argument is left alone
+            timings().setStyle(Timings::Style::KeyValue);
+        } else if (arg == "--timings=json") {
+            timings().setStyle(Timings::Style::Json);
+        } else if (arg == "--tui") {
+            tuiMode = true;
+        } else if (arg == "--all-netns") {
+            allNamespaces = true;
+        } else if (arg == "--up-only") {
+            filter.upOnly = true;
+        } else if (matchOption(arg, "--type", argc, argv, i, value)) {
+            filter.linkType = value;
+        } else if (matchOption(arg, "--iface", argc, argv, i, value)) {
+            interfaceSelector.kind = InterfaceSelector::Kind::Name;
+            interfaceSelector.value = value;
+        } else if (matchOption(arg, "--index", argc, argv, i, value)) {
+            if (!parsePositionSelector(value, interfaceSelector)) {
+                errorMessage() << "Invalid interface index: " << value << '\n';
+                return 1;
+            }
+        } else if (arg == "--first-up") {
+            interfaceSelector.kind = InterfaceSelector::Kind::FirstUp;
+        } else if (matchOption(arg, "--match", argc, argv, i, value)) {
+            interfaceSelector.kind = InterfaceSelector::Kind::Match;
+            interfaceSelector.value = value;
+        } else if (arg == "--numa-local" || arg.compare(0, 13, "--numa-local=") == 0) {
+            // The node is optional, so there is no "--numa-local NODE" form
+            std::string node{arg.size() > 12 ? arg.substr(13) : std::string_view{}};
+            if (!parseNumaSelector(node, interfaceSelector)) {
+                errorMessage() << "Invalid NUMA node: " << node << '\n';
+                return 1;
+            }
+        } else if (arg == "--least-loaded" || arg.compare(0, 15, "--least-loaded=") == 0) {
+            // The interval is optional, so there is no "--least-loaded INTERVAL" form
+            if (arg.size() > 14 && !parseLoadInterval(std::string{arg.substr(15)}, loadInterval)) {
+                errorMessage() << "Invalid interval: " << arg.substr(15) << '\n';
+                return 1;
+            }
+            interfaceSelector.kind = InterfaceSelector::Kind::LeastLoaded;
+        } else if (matchOption(arg, "--owner-of", argc, argv, i, value)) {
+            if (!parseOwnerSelector(value, interfaceSelector)) {
+                errorMessage() << "Invalid address: " << value << '\n';
+                return 1;
+            }
+        } else if (matchOption(arg, "--route-to", argc, argv, i, value)) {
+            if (!parseBatchSelector(value, interfaceSelector) ||
+                interfaceSelector.kind != InterfaceSelector::Kind::Route) {
+                errorMessage() << "Invalid destination address: " << value << '\n';
+                return 1;
+            }
+        } else {
+            errorMessage() << "Unknown argument: " << arg << '\n';
+            showHelp(programName);
+            return 1;
         }
     }
 
-    // Commands that can be used
-    const static char* COMMAND_IP{"ip a"};
+    // With --timings, the report is written when main returns, whichever way it does
+    struct TimingsReport {
+        TimedPhase total{Phase::Total};
+        ~TimingsReport() {
+            total.stop();
+            timings().report();
+        }
+    } timingsReport;
+
+    // Whatever this run allocates, starting on the stack (see arena.hpp)
+    RunArena arena;
 
-    /* Open a pipe for the 'ip a' command
-     * - std::unique_ptr<FILE, decltype(&pclose)>: Uses a unique pointer to manage the FILE* returned by popen,
-     *   specifying that the pclose function should be used to close the resource when the unique pointer goes out of
-     *   scope.
-     *
-     * decltype(&pclose): Returns the type of the pointer to the pclose function. In the context of std::unique_ptr, this
-     *                     informs the compiler which function to use to delete the resource when the unique pointer is
-     *                     destroyed.
-     */
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(COMMAND_IP, "r"), pclose);
+    // Table of interfaces with their addresses
+    InterfaceTable interfaceList{arena.resource()};
+    auto countTable{[&](Backend usedBackend) {
+        timings().setBackend(backendName(usedBackend));
+        timings().count(Counter::Interfaces, interfaceList.size());
+        timings().count(Counter::Addresses, interfaceList.addressTotal());
+    }};
 
-    // Check if the pipe was opened correctly
-    if (!pipe) {
-        std::cerr << "Error opening pipe for command: " << COMMAND_IP << std::endl;
+    // Traffic rates, sampled once the table is there if the selector or the fields need them (see load.hpp)
+    LinkLoad load{arena.resource()};
+    auto sampleLoad{[&]() {
+        if (interfaceSelector.kind != InterfaceSelector::Kind::LeastLoaded && !fields.needsLoad()) {
+            return true;
+        }
+        TimedPhase selectPhase{Phase::Select};
+        if (!load.sample(loadInterval)) {
+            errorMessage() << "Error sampling the interface counters" << '\n';
+            return false;
+        }
+        fields.setLoad(&load);
+        if (interfaceSelector.kind == InterfaceSelector::Kind::LeastLoaded) {
+            interfaceSelector.index = load.leastLoaded(interfaceList);
+        }
+        return true;
+    }};
+
+    // Sysfs attributes of the fields, read for every interface at once when the whole table is listed
+    SysfsAttributes attributes{interfaceList};
+    auto collectAttributes{[&]() {
+        attributes.collect(fields.sysfsAttributes(interfaceList));
+        fields.setAttributes(&attributes);
+    }};
+
+    if (daemonMode) {
+        return runDaemon();
+    }
+
+    if (watchMode) {
+        if (interfaceSelector.kind != InterfaceSelector::Kind::Prompt &&
+            interfaceSelector.kind != InterfaceSelector::Kind::Name &&
+            interfaceSelector.kind != InterfaceSelector::Kind::Match) {
+            errorMessage() << "--watch only supports --iface and --match" << '\n';
+            return 1;
+        }
+        return runWatch(filter, interfaceSelector);
+    }
+
+    if (!backendSupports(backend, filter)) {
+        errorMessage() << "--type requires the netlink backend" << '\n';
         return 1;
     }
 
-    // List to store pairs (interface name, IP address)
-    std::vector<std::pair<std::string, std::string>> interfaceList;
-
-    char buffer[128];           // Buffer to store the line read from the pipe
-    std::string interfaceName;  // Interface name
-    std::string ipAddress;      // Interface IP address
-
-    // Read the pipe line by line
-    while (fgets(buffer, sizeof(buffer), pipe.get()) != nullptr) {
-        std::string line{buffer};
-        std::istringstream iss{line};
-
-        // Search for a line with the format: #: [interface name]: <...
-        size_t pos{line.find(": <")};
-        if (pos == std::string::npos) {
-            // Format not found, ignore the line
-            continue;
-        }
-
-        // Get the interface name, ignoring the index (first 3 characters)
-        interfaceName = line.substr(3, pos - 3);
-
-        // Search the following lines for the interface IP address
-        // If a line starts with the current index followed by ":",
-        // it means the interface has no configured IP address
-        // (skip to the next interface)
-        while (fgets(buffer, sizeof(buffer), pipe.get()) != nullptr) {
-            line = buffer;
-            pos = line.find(": <");
-            if (pos != std::string::npos) { // Found a new interface
-                /*
-                 * Save the current interface in the list indicating that it has no configured IP address.
-                 * - std::emplace_back: Directly constructs a pair (interface name, IP address) at the end of the vector,
-                 *   avoiding the need to create temporary variables before insertion.
-                 */
-                interfaceList.emplace_back(interfaceName, "<no ip address>");
-
-                // Get the name of the new interface, ignoring the index (first 3 characters)
-                interfaceName = line.substr(3, pos - 3);
-                continue;
+    // With only IPv6 addresses enumerated, or the owner of an IPv6 address wanted, show the first IPv6 address unless
+    // told otherwise
+    if ((filter.family == AF_INET6 || (interfaceSelector.kind == InterfaceSelector::Kind::OwnerOf &&
+                                       interfaceSelector.value.find(':') != std::string::npos)) &&
+        !addressSelectorGiven) {
+        addressSelector.kind = AddressSelector::Kind::Inet6;
+    }
+
+    // Link attributes and NUMA nodes are looked up locally, in the current namespace
+    if (!fields.empty() && (!hostsFile.empty() || allNamespaces || outputFormat == OutputFormat::Image)) {
+        errorMessage() << "--fields cannot be combined with --hosts, --all-netns or --format=image" << '\n';
+        return 1;
+    }
+    if ((interfaceSelector.kind == InterfaceSelector::Kind::NumaLocal ||
+         interfaceSelector.kind == InterfaceSelector::Kind::LeastLoaded) &&
+        (!hostsFile.empty() || allNamespaces)) {
+        errorMessage() << "--numa-local and --least-loaded cannot be combined with --hosts or --all-netns" << '\n';
+        return 1;
+    }
+    resolveNumaSelector(interfaceSelector);
+    interfaceList.keepLinkAttributes(fields.needsLinkAttributes());
+
+    if (!hostsFile.empty()) {
+        if (batchMode || allNamespaces || interfaceSelector.kind == InterfaceSelector::Kind::Route ||
+            outputFormat == OutputFormat::Image) {
+            errorMessage() << "--hosts cannot be combined with --batch, --all-netns, --route-to or --format=image"
+                           << '\n';
+            return 1;
+        }
+        std::vector<FleetTarget> targets;
+        std::string error;
+        if (!readFleetTargets(hostsFile, targets, error)) {
+            errorMessage() << error << '\n';
+            return 1;
+        }
+
+        // Each host's result is written as soon as it is in
+        bool allSelected{true};
+        bool firstHost{true};
+        OutputBuffer out;
+        FleetCollector collector{filter, fleetOptions};
+        collector.run(targets, [&](const FleetTarget& target, const InterfaceTable* table, std::string error) {
+            out.clear();
+            if (!firstHost && (outputFormat == OutputFormat::Text || outputFormat == OutputFormat::Env)) {
+                out += '\n';
+            }
+            firstHost = false;
+            if (!appendHostResult(out, outputFormat, target, table, error, interfaceSelector, addressSelector)) {
+                // tsv and nul have no room for errors
+                if (outputFormat == OutputFormat::Tsv || outputFormat == OutputFormat::Nul) {
+                    errorMessage() << target.label << ": " << error << '\n';
+                }
+                allSelected = false;
             }
+            writeOutput(STDOUT_FILENO, out);
+        });
+        return allSelected ? 0 : 1;
+    }
 
-            // Check if the line contains an IP address
-            pos = line.find("inet ");
-            if (pos != std::string::npos) {
-                // Skip the string "inet " and the space
-                pos += 5;
-                std::string ipAddress{line.substr(pos, line.find('/', pos) - pos)};
-                interfaceList.emplace_back(interfaceName, ipAddress);
+    if (allNamespaces && (batchMode || interfaceSelector.kind == InterfaceSelector::Kind::Route)) {
+        errorMessage() << "--all-netns cannot be combined with --batch or --route-to" << '\n';
+        return 1;
+    }
 
-                // Clear the variables to validate the end of the pipe
-                interfaceName.clear();
-                ipAddress.clear();
-                break;
+    if (batchMode) {
+        if (interfaceSelector.kind != InterfaceSelector::Kind::Prompt) {
+            errorMessage() << "--batch takes its selectors as arguments or on stdin" << '\n';
+            return 1;
+        }
+        if (batchArguments.empty()) {
+            readBatchSelectors(STDIN_FILENO, batchArguments);
+        }
+        std::vector<InterfaceSelector> batchSelectors(batchArguments.size());
+        for (std::size_t i = 0; i < batchArguments.size(); ++i) {
+            if (!parseBatchSelector(batchArguments[i], batchSelectors[i])) {
+                errorMessage() << "Invalid selector: " << batchArguments[i] << '\n';
+                return 1;
             }
         }
+        if (!resolveRouteSelectors(batchSelectors, filter)) {
+            return 1;
+        }
+        // As with --route-to, the route's source is shown whichever its family, unless told otherwise
+        AddressSelector routeAddressSelector{addressSelector};
+        if (!addressSelectorGiven) {
+            routeAddressSelector.kind = AddressSelector::Kind::Any;
+        }
+
+        Backend usedBackend{backend};
+        bool enumerated;
+        {
+            TimedPhase enumeratePhase{Phase::Enumerate};
+            enumerated = enumerateThroughCache(backend, interfaceList, filter, usedBackend);
+        }
+        if (!enumerated) {
+            errorMessage() << "Error listing interfaces with backend: " << backendName(usedBackend) << '\n';
+            return 1;
+        }
+        countTable(usedBackend);
+        if (!sampleLoad()) {
+            return 1;
+        }
+        TimedPhase outputPhase{Phase::Output};
+        OutputBuffer out{arena.resource()};
+        reserveOutput(out, interfaceList);
+        bool allFound{appendBatchResults(out, outputFormat, interfaceList, batchSelectors, addressSelector,
+                                         routeAddressSelector, &fields)};
+        return writeOutput(STDOUT_FILENO, out) && allFound ? 0 : 1;
     }
 
-    if (interfaceName.length() > 0) {
-        // Save the last interface in the list indicating that it has no configured IP address
-        interfaceList.emplace_back(interfaceName, "<no ip address>");
+    // Namespace of each interface, with --all-netns
+    NamespaceTable namespaceTable;
+    auto namespaceOf{[&](std::size_t position) {
+        return allNamespaces ? std::string_view{namespaceTable.namespaceName(position)} : std::string_view{};
+    }};
+
+    // Selecting by name only needs that one interface, which can be looked up directly
+    Backend usedBackend{backend};
+    bool enumerated;
+    TimedPhase enumeratePhase{Phase::Enumerate};
+    if (interfaceSelector.kind == InterfaceSelector::Kind::Route) {
+        // The kernel's routing decision only needs a route lookup, not the list of interfaces
+        if (backend != Backend::Auto && backend != Backend::Netlink) {
+            errorMessage() << "--route-to requires the netlink backend" << '\n';
+            return 1;
+        }
+        usedBackend = Backend::Netlink;
+        in6_addr destination;
+        int family{inet_pton(AF_INET, interfaceSelector.value.c_str(), &destination) == 1 ? AF_INET : AF_INET6};
+        inet_pton(family, interfaceSelector.value.c_str(), &destination);
+        RouteLookup route;
+        enumerated = enumerateRouteWithNetlink(interfaceList, family, &destination, filter, route);
+        interfaceSelector.index = route.index;
+        if (!addressSelectorGiven) {
+            addressSelector.kind = AddressSelector::Kind::Any;
+        }
+    } else if (allNamespaces) {
+        // Each namespace is dumped in parallel over netlink; the records keep track of their namespace
+        if (backend != Backend::Auto && backend != Backend::Netlink) {
+            errorMessage() << "--all-netns requires the netlink backend" << '\n';
+            return 1;
+        }
+        usedBackend = Backend::Netlink;
+        enumerated = enumerateAllNamespaces(namespaceTable, filter);
+        interfaceList = std::move(namespaceTable.interfaceList);
+    } else if (interfaceSelector.kind == InterfaceSelector::Kind::Name) {
+        enumerated = enumerateInterface(backend, interfaceSelector.value, interfaceList, filter, usedBackend);
+    } else {
+        enumerated = enumerateThroughCache(backend, interfaceList, filter, usedBackend);
+    }
+    enumeratePhase.stop();
+    if (!enumerated) {
+        errorMessage() << "Error listing interfaces with backend: " << backendName(usedBackend) << '\n';
+        return 1;
+    }
+    countTable(usedBackend);
+    if (!sampleLoad()) {
+        return 1;
     }
 
-    // Display the list of interfaces and IP addresses
-    std::cout << "List of Interfaces and IP Addresses:" << std::endl;
-    for (std::size_t i = 0; i < interfaceList.size(); ++i) {
-        const auto& entry = interfaceList[i];
-        std::cout << i + 1 << " - Interface: " << entry.first << ", IP: " << entry.second << std::endl;
+    // Everything is rendered into one buffer and written at once
+    OutputBuffer out{arena.resource()};
+    reserveOutput(out, interfaceList);
+
+    if (outputFormat == OutputFormat::Image) {
+        // Binary table for another ifacepicker (fleet mode); selection is up to the reader
+        if (interfaceSelector.kind != InterfaceSelector::Kind::Prompt) {
+            errorMessage() << "--format=image always outputs every interface" << '\n';
+            return 1;
+        }
+        appendDaemonReply(out, interfaceList);
+        return writeOutput(STDOUT_FILENO, out) ? 0 : 1;
     }
 
-    std::cout << std::endl;
-    std::cout << "Choose an interface: ";
     std::size_t interfaceIndex;
-    std::cin >> interfaceIndex;
-    --interfaceIndex; // Adjust the index for the vector of interfaces
+    if (interfaceSelector.kind != InterfaceSelector::Kind::Prompt) {
+        // Scripted selection: no listing and no prompt
+        TimedPhase selectPhase{Phase::Select};
+        interfaceIndex = findInterface(interfaceList, interfaceSelector);
+        selectPhase.stop();
+        if (interfaceIndex == NO_INTERFACE) {
+            errorMessage() << "No interface found for: " << describeSelector(interfaceSelector) << '\n';
+            return 1;
+        }
+    } else if (tuiMode) {
+        // Full-screen search instead of the list and the prompt
+        collectAttributes();
+        bool picked{runPicker(interfaceList, [&](OutputBuffer& row, std::size_t position) {
+            const InterfaceRecord& entry{interfaceList[position]};
+            if (!fields.empty()) {
+                appendInterfaceFields(row, OutputFormat::Text, interfaceList, entry, addressSelector,
+                                      namespaceOf(position), fields);
+                return;
+            }
+            if (allNamespaces) {
+                row += namespaceOf(position);
+                row += '/';
+            }
+            row += entry.name;
+            row.append(row.size() < IFNAMSIZ + 2 ? IFNAMSIZ + 2 - row.size() : 1, ' ');
+            appendSelectedAddresses(row, interfaceList.addresses(entry), addressSelector);
+        }, interfaceIndex)};
+        if (!picked) {
+            errorMessage() << "--tui needs a terminal" << '\n';
+            return 1;
+        }
+        if (interfaceIndex == NO_INTERFACE) {
+            return 1;
+        }
+    } else if (outputFormat != OutputFormat::Text) {
+        // Machine-readable listing of every interface, without a prompt
+        TimedPhase outputPhase{Phase::Output};
+        collectAttributes();
+        appendInterfaceList(out, outputFormat, interfaceList, addressSelector, namespaceOf, &fields);
+        return writeOutput(STDOUT_FILENO, out) ? 0 : 1;
+    } else {
+        // Display the list of interfaces and IP addresses
+        collectAttributes();
+        out += "List of Interfaces and IP Addresses:\n";
+        for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+            const auto& entry = interfaceList[i];
+            out += std::to_string(i + 1);
+            if (!fields.empty()) {
+                out += " - ";
+                appendInterfaceFields(out, OutputFormat::Text, interfaceList, entry, addressSelector, {}, fields);
+                out += '\n';
+                continue;
+            }
+            if (allNamespaces) {
+                out += " - Namespace: ";
+                out += namespaceOf(i);
+                out += ", Interface: ";
+            } else {
+                out += " - Interface: ";
+            }
+            out += entry.name;
+            out += ", IP: ";
+            appendSelectedAddresses(out, interfaceList.addresses(entry), addressSelector);
+            out += '\n';
+        }
+        out += "\nChoose an interface: ";
+        writeOutput(STDOUT_FILENO, out);
+        out.clear();
 
-    // Check if the interface index is valid
-    if (interfaceIndex < 0 || interfaceIndex >= interfaceList.size()) {
-        std::cerr << "Invalid interface index!" << std::endl;
-        return 1;
+        // Anything but a number is an invalid index
+        std::string answer;
+        readLine(STDIN_FILENO, answer);
+        interfaceIndex = std::strtoul(answer.c_str(), nullptr, 10);
+        --interfaceIndex; // Adjust the index for the vector of interfaces
+
+        // Check if the interface index is valid
+        if (interfaceIndex < 0 || interfaceIndex >= interfaceList.size()) {
+            errorMessage() << "Invalid interface index!" << '\n';
+            return 1;
+        }
     }
 
     // Display the selected interface
+    TimedPhase outputPhase{Phase::Output};
     const auto& selectedInterface = interfaceList[interfaceIndex];
-    std::cout << "IFACE=" << selectedInterface.first << std::endl;
-    std::cout << "IPADDR=" << (selectedInterface.second.empty() ? "<no ip address>" : selectedInterface.second) << std::endl;
+    appendInterface(out, outputFormat == OutputFormat::Text ? OutputFormat::Env : outputFormat, interfaceList,
+                    selectedInterface, addressSelector, namespaceOf(interfaceIndex), &fields);
+    if (outputFormat == OutputFormat::Json) {
+        out += '\n';
+    }
+    if (!writeOutput(STDOUT_FILENO, out)) {
+        return 1;
+    }
 
     return 0;
 }
@@ -0,0 +1,739 @@
+/*
+ * netlink.hpp - Native rtnetlink access for ifacepicker.
+ *
+ * Instead of spawning 'ip a' and parsing its text output, the kernel is asked directly over an AF_NETLINK socket
+ * using RTM_GETLINK and RTM_GETADDR dump requests, sent at once on two sockets so that neither waits for the other.
+ * The replies are binary messages carrying typed attributes (struct rtattr), which are decoded in place without any
+ * intermediate text. Route lookups (RTM_GETROUTE) answer which interface the kernel would use to reach a destination.
+ */
+
+#ifndef IFACEPICKER_NETLINK_HPP
+#define IFACEPICKER_NETLINK_HPP
+
+#include <arpa/inet.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "timings.hpp"
+
+// Older libc headers lack these (Linux 4.20)
+#ifndef SOL_NETLINK
+#define SOL_NETLINK 270
+#endif
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK 12
+#endif
+
+// Longest link-layer address in IFLA_ADDRESS (MAX_ADDR_LEN, from <linux/netdevice.h>, which clashes with <net/if.h>)
+constexpr std::size_t LINK_ADDRESS_MAX{32};
+
+// Size of a receive slot; the kernel builds dump datagrams of at most 32 KiB unless a single message is larger
+constexpr std::size_t NETLINK_BUFFER_SIZE{32768};
+
+// Datagrams received with a single recvmmsg(2): the kernel builds the next dump datagram as each one is taken
+constexpr unsigned int NETLINK_RECEIVE_SLOTS{8};
+
+// Function to get the slot size new sockets start with: NETLINK_BUFFER_SIZE, or the largest datagram that did not fit
+// in a slot so far in this process (rounded up to pages)
+inline std::atomic<std::size_t>& netlinkSlotSize() {
+    static std::atomic<std::size_t> size{NETLINK_BUFFER_SIZE};
+    return size;
+}
+
+/*
+ * Run a netlink exchange (a callable returning bool) again if it failed on a datagram larger than the receive slots,
+ * which are then large enough (see NetlinkSocket::receiveSome). The exchange must start over from an empty result.
+ */
+template <typename Exchange>
+inline bool retryOnLargeDatagram(Exchange&& exchange) {
+    std::size_t slotSize{netlinkSlotSize().load(std::memory_order_relaxed)};
+    return exchange() || (netlinkSlotSize().load(std::memory_order_relaxed) != slotSize && exchange());
+}
+
+/*
+ * Request message under construction: a netlink header, a fixed family-specific payload (ifinfomsg, ifaddrmsg, ...)
+ * and optional trailing attributes. Everything lives in a small aligned array, so building a request never allocates.
+ */
+class NetlinkRequest {
+public:
+    NetlinkRequest(std::uint16_t type, std::uint16_t flags, const void* payload, std::size_t payloadLength) {
+        header()->nlmsg_len = NLMSG_LENGTH(payloadLength);
+        header()->nlmsg_type = type;
+        header()->nlmsg_flags = flags;
+        std::memcpy(NLMSG_DATA(header()), payload, payloadLength);
+    }
+
+    // Append a (type, value) attribute after the payload; returns false if the request buffer is full
+    bool addAttribute(std::uint16_t type, const void* value, std::size_t length) {
+        std::size_t offset{NLMSG_ALIGN(header()->nlmsg_len)};
+        if (offset + RTA_SPACE(length) > sizeof(data)) {
+            return false;
+        }
+
+        auto* attribute{reinterpret_cast<rtattr*>(data + offset)};
+        attribute->rta_type = type;
+        attribute->rta_len = RTA_LENGTH(length);
+        if (length > 0) {
+            std::memcpy(RTA_DATA(attribute), value, length);
+        }
+        header()->nlmsg_len = offset + RTA_ALIGN(attribute->rta_len);
+        return true;
+    }
+
+    // Open a nested attribute: attributes added until endNested() become its children
+    rtattr* beginNested(std::uint16_t type) {
+        if (!addAttribute(type, nullptr, 0)) {
+            return nullptr;
+        }
+        return reinterpret_cast<rtattr*>(data + header()->nlmsg_len - RTA_SPACE(0));
+    }
+
+    void endNested(rtattr* nested) {
+        if (nested != nullptr) {
+            nested->rta_len = static_cast<unsigned short>(data + header()->nlmsg_len - reinterpret_cast<char*>(nested));
+        }
+    }
+
+    nlmsghdr* header() { return reinterpret_cast<nlmsghdr*>(data); }
+
+private:
+    alignas(NLMSG_ALIGNTO) char data[256]{};
+};
+
+/*
+ * Owns an AF_NETLINK/NETLINK_ROUTE socket and the buffer used to receive replies.
+ * - open(): Creates and binds the socket, optionally subscribing to multicast groups.
+ * - send(): Stamps a sequence number on the request and sends it to the kernel.
+ * - receive(): Reads replies for the last request, invoking the handler once per message until the dump is done.
+ * - receiveSome(): Reads the replies that are queued, for callers that wait on several sockets.
+ * Replies are read with recvmmsg(2) into NETLINK_RECEIVE_SLOTS slots of one buffer, so a dump of tens of thousands of
+ * addresses takes a few syscalls per slot count rather than one per datagram. The first datagram of each dump is
+ * peeked at (MSG_PEEK | MSG_TRUNC) to grow the slots if the kernel had to build a datagram larger than a slot. A later
+ * datagram can still be larger (when one message is); it is lost once received, so the exchange fails with EMSGSIZE
+ * after recording its size in netlinkSlotSize(), and the enumerations run it again (see retryOnLargeDatagram).
+ * The buffer holds a single slot until a dump turns out to be large, so that a one-shot query (--iface lo) does not
+ * allocate and fault in the pages of all the slots; it is left uninitialised, the kernel only writes what it sends.
+ */
+class NetlinkSocket {
+public:
+    // The receive buffer is allocated from `memory`
+    explicit NetlinkSocket(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) : memory{memory} {}
+    NetlinkSocket(const NetlinkSocket&) = delete;
+    NetlinkSocket& operator=(const NetlinkSocket&) = delete;
+
+    ~NetlinkSocket() {
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (buffer != nullptr) {
+            memory->deallocate(buffer, bufferSize, alignof(nlmsghdr));
+        }
+    }
+
+    bool open(std::uint32_t groups = 0) {
+        TimedPhase phase{Phase::Open};
+        fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (fd < 0) {
+            return false;
+        }
+
+        sockaddr_nl local{};
+        local.nl_family = AF_NETLINK;
+        local.nl_groups = groups;
+        if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+            close(fd);
+            fd = -1;
+            return false;
+        }
+
+        reserveBuffer(slotSize);
+        return true;
+    }
+
+    bool send(NetlinkRequest& request) {
+        nlmsghdr* header{request.header()};
+        header->nlmsg_seq = ++sequence;
+        header->nlmsg_pid = 0;
+
+        sockaddr_nl kernel{};
+        kernel.nl_family = AF_NETLINK;
+        ssize_t sent;
+        do {
+            sent = sendto(fd, header, header->nlmsg_len, 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel));
+        } while (sent < 0 && errno == EINTR);
+        lastError = sent < 0 ? errno : 0;
+        sized = (header->nlmsg_flags & NLM_F_DUMP) != NLM_F_DUMP;
+        return sent == static_cast<ssize_t>(header->nlmsg_len);
+    }
+
+    /*
+     * Receive all replies to the last request sent.
+     * The handler is called as handler(const nlmsghdr*) for every data message; NLMSG_DONE ends a dump and an
+     * NLMSG_ERROR with a zero code ends an acknowledged request. Returns false on socket or kernel errors, leaving
+     * the kernel error code in lastError.
+     */
+    template <typename Handler>
+    bool receive(Handler&& handler) {
+        lastError = 0;
+        bool done{false};
+        while (!done) {
+            if (!receiveSome(handler, done)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Receive the replies to the last request that are available with one recvmmsg(2), blocking until there is at
+     * least one, and set `done` once the last reply was handled. Returns false as receive() does; a datagram that did
+     * not fit in a slot fails with EMSGSIZE, and makes the slots of this socket and of those opened later fit it.
+     */
+    template <typename Handler>
+    bool receiveSome(Handler&& handler, bool& done) {
+        if (!sized && !sizeSlots()) {
+            return false;
+        }
+
+        mmsghdr datagrams[NETLINK_RECEIVE_SLOTS]{};
+        iovec vectors[NETLINK_RECEIVE_SLOTS];
+        unsigned int slots{
+            static_cast<unsigned int>(std::min<std::size_t>(bufferSize / slotSize, NETLINK_RECEIVE_SLOTS))};
+        for (unsigned int i = 0; i < slots; ++i) {
+            vectors[i] = iovec{buffer + i * slotSize, slotSize};
+            datagrams[i].msg_hdr.msg_iov = &vectors[i];
+            datagrams[i].msg_hdr.msg_iovlen = 1;
+        }
+        int count;
+        do {
+            // With MSG_TRUNC, netlink reports the full length of a datagram that was cut short
+            count = recvmmsg(fd, datagrams, slots, MSG_WAITFORONE | MSG_TRUNC, nullptr);
+        } while (count < 0 && errno == EINTR);
+        if (count < 0) {
+            lastError = errno;
+            return false;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (datagrams[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                growSlots(datagrams[i].msg_len);
+                lastError = EMSGSIZE;
+                return false;
+            }
+            timings().count(Counter::BytesRead, datagrams[i].msg_len);
+            unsigned int remaining{datagrams[i].msg_len};
+            for (auto* message{reinterpret_cast<const nlmsghdr*>(buffer + i * slotSize)};
+                 NLMSG_OK(message, remaining); message = NLMSG_NEXT(message, remaining)) {
+                timings().count(Counter::MessagesRead);
+                if (message->nlmsg_seq != sequence) {
+                    // Stale reply to an earlier request (or a notification): not ours
+                    continue;
+                }
+                if (message->nlmsg_type == NLMSG_DONE) {
+                    done = true;
+                    return true;
+                }
+                if (message->nlmsg_type == NLMSG_ERROR) {
+                    const auto* error{static_cast<const nlmsgerr*>(NLMSG_DATA(message))};
+                    lastError = -error->error;
+                    done = true;
+                    return error->error == 0;
+                }
+                handler(message);
+                if (!(message->nlmsg_flags & NLM_F_MULTI)) {
+                    // Single reply to a non-dump request
+                    done = true;
+                    return true;
+                }
+            }
+        }
+        return true;
+    }
+
+    /*
+     * Read one batch of multicast notifications without blocking, calling handler(const nlmsghdr*) for each message.
+     * Returns false when there is nothing left to read or on error; error() is then EAGAIN in the first case, and
+     * ENOBUFS means the kernel dropped notifications because the socket buffer was full (the state must be re-read).
+     * A notification larger than the buffer is lost the same way: it fails with ENOBUFS, after growing the buffer to
+     * fit it.
+     */
+    template <typename Handler>
+    bool receiveEvents(Handler&& handler) {
+        // With MSG_TRUNC, netlink reports the full length of a datagram that was cut short
+        ssize_t length{recv(fd, buffer, bufferSize, MSG_DONTWAIT | MSG_TRUNC)};
+        if (length < 0) {
+            lastError = errno == EWOULDBLOCK ? EAGAIN : errno;
+            return false;
+        }
+        if (static_cast<std::size_t>(length) > bufferSize) {
+            reserveBuffer(pageMultiple(static_cast<std::size_t>(length)));
+            lastError = ENOBUFS;
+            return false;
+        }
+
+        lastError = 0;
+        auto remaining{static_cast<unsigned int>(length)};
+        for (auto* message{reinterpret_cast<const nlmsghdr*>(buffer)}; NLMSG_OK(message, remaining);
+             message = NLMSG_NEXT(message, remaining)) {
+            if (message->nlmsg_type != NLMSG_DONE && message->nlmsg_type != NLMSG_ERROR) {
+                handler(message);
+            }
+        }
+        return true;
+    }
+
+    // Subscribe to a multicast group (RTNLGRP_LINK, RTNLGRP_IPV4_IFADDR, ...)
+    bool joinGroup(unsigned int group) {
+        return setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group)) == 0;
+    }
+
+    /*
+     * Ask the kernel to validate dump requests strictly and to honour the filters they carry (such as ifa_index in
+     * an RTM_GETADDR dump) instead of ignoring them. Returns false on kernels without NETLINK_GET_STRICT_CHK.
+     */
+    bool enableStrictCheck() {
+        int enable{1};
+        strictCheck = setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK, &enable, sizeof(enable)) == 0;
+        return strictCheck;
+    }
+
+    bool hasStrictCheck() const { return strictCheck; }
+    int descriptor() const { return fd; }
+    int error() const { return lastError; }
+
+private:
+    // Function to peek at the size of the first datagram of a dump, growing the slots if it would not fit in one
+    bool sizeSlots() {
+        ssize_t size;
+        do {
+            size = recv(fd, nullptr, 0, MSG_PEEK | MSG_TRUNC);
+        } while (size < 0 && errno == EINTR);
+        if (size < 0) {
+            lastError = errno;
+            return false;
+        }
+        if (static_cast<std::size_t>(size) > slotSize) {
+            slotSize = pageMultiple(static_cast<std::size_t>(size));
+        }
+        // The kernel fills each datagram of a dump before starting the next: a short first one is the whole dump
+        if (static_cast<std::size_t>(size) >= NETLINK_BUFFER_SIZE / 2) {
+            reserveBuffer(slotSize * NETLINK_RECEIVE_SLOTS);
+        } else {
+            reserveBuffer(slotSize);
+        }
+        sized = true;
+        return true;
+    }
+
+    static std::size_t pageMultiple(std::size_t size) { return (size + 4095) & ~static_cast<std::size_t>(4095); }
+
+    // Function to make the slots fit a datagram of `length` bytes, here and in the sockets opened from now on
+    void growSlots(std::size_t length) {
+        bool severalSlots{bufferSize > slotSize};
+        slotSize = std::max(slotSize, pageMultiple(length));
+        std::size_t shared{netlinkSlotSize().load(std::memory_order_relaxed)};
+        while (shared < slotSize && !netlinkSlotSize().compare_exchange_weak(shared, slotSize)) {
+        }
+        reserveBuffer(slotSize * (severalSlots ? NETLINK_RECEIVE_SLOTS : 1));
+    }
+
+    // Function to make the receive buffer at least `size` bytes, dropping its contents
+    void reserveBuffer(std::size_t size) {
+        if (bufferSize >= size) {
+            return;
+        }
+        if (buffer != nullptr) {
+            memory->deallocate(buffer, bufferSize, alignof(nlmsghdr));
+        }
+        buffer = static_cast<char*>(memory->allocate(size, alignof(nlmsghdr)));
+        bufferSize = size;
+    }
+
+    int fd{-1};
+    std::uint32_t sequence{0};
+    int lastError{0};
+    bool strictCheck{false};
+    bool sized{true}; // Whether the slots were sized for the reply to the last request
+    std::size_t slotSize{netlinkSlotSize().load(std::memory_order_relaxed)};
+    std::pmr::memory_resource* memory;
+    char* buffer{nullptr};
+    std::size_t bufferSize{0};
+};
+
+/*
+ * Index the attributes following a fixed payload into a table by type.
+ * - table: Array of (maxType + 1) pointers, cleared before parsing; absent attributes stay nullptr.
+ */
+inline void parseAttributes(const rtattr* attribute, int length, const rtattr** table, int maxType) {
+    std::memset(table, 0, sizeof(*table) * (maxType + 1));
+    for (; RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+        if (attribute->rta_type <= maxType) {
+            table[attribute->rta_type] = attribute;
+        }
+    }
+}
+
+// Convenience: attributes of an RTM_NEWLINK message
+inline void parseLinkAttributes(const nlmsghdr* message, const rtattr** table) {
+    const auto* info{static_cast<const ifinfomsg*>(NLMSG_DATA(message))};
+    parseAttributes(IFLA_RTA(info), IFLA_PAYLOAD(message), table, IFLA_MAX);
+}
+
+// Convenience: attributes of an RTM_NEWADDR message
+inline void parseAddressAttributes(const nlmsghdr* message, const rtattr** table) {
+    const auto* info{static_cast<const ifaddrmsg*>(NLMSG_DATA(message))};
+    parseAttributes(IFA_RTA(info), IFA_PAYLOAD(message), table, IFA_MAX);
+}
+
+// Function to get the IFLA_INFO_KIND ("veth", "bond", ...) nested in IFLA_LINKINFO; empty if the link has none
+inline std::string_view linkKind(const rtattr* const* linkAttributes) {
+    if (linkAttributes[IFLA_LINKINFO] == nullptr) {
+        return {};
+    }
+    const rtattr* info[IFLA_INFO_MAX + 1];
+    parseAttributes(static_cast<const rtattr*>(RTA_DATA(linkAttributes[IFLA_LINKINFO])),
+                    RTA_PAYLOAD(linkAttributes[IFLA_LINKINFO]), info, IFLA_INFO_MAX);
+    if (info[IFLA_INFO_KIND] == nullptr) {
+        return {};
+    }
+    return std::string_view{static_cast<const char*>(RTA_DATA(info[IFLA_INFO_KIND]))};
+}
+
+/*
+ * Build the RTM_GETLINK dump request, pushing what the kernel can filter by itself into it: a link kind is sent as
+ * IFLA_LINKINFO/IFLA_INFO_KIND, which the kernel matches before it builds each reply message.
+ */
+inline NetlinkRequest makeLinkDumpRequest(const InterfaceFilter& filter) {
+    ifinfomsg info{};
+    info.ifi_family = AF_UNSPEC;
+    NetlinkRequest request{RTM_GETLINK, NLM_F_REQUEST | NLM_F_DUMP, &info, sizeof(info)};
+    if (filter.hasLinkKind()) {
+        rtattr* linkInfo{request.beginNested(IFLA_LINKINFO)};
+        request.addAttribute(IFLA_INFO_KIND, filter.linkType.c_str(), filter.linkType.size() + 1);
+        request.endNested(linkInfo);
+    }
+    return request;
+}
+
+// Function to build the RTM_GETADDR dump request; the family filter is applied by the kernel
+inline NetlinkRequest makeAddressDumpRequest(const InterfaceFilter& filter, unsigned int index = 0) {
+    ifaddrmsg info{};
+    info.ifa_family = static_cast<unsigned char>(filter.family);
+    info.ifa_index = index;
+    return NetlinkRequest{RTM_GETADDR, NLM_F_REQUEST | NLM_F_DUMP, &info, sizeof(info)};
+}
+
+/*
+ * Adds RTM_NEWLINK and RTM_NEWADDR messages to an interface table, matching addresses to their interface by ifindex.
+ * Links and addresses rejected by the filter are skipped before anything is stored (whether or not the kernel
+ * already filtered them). finish() must be called once all messages have been added.
+ * When both dumps stream in at the same time, addresses are held (see deferAddresses) until every link is known.
+ */
+struct NetlinkTableBuilder {
+    // An address received before the link dump was complete
+    struct HeldAddress {
+        int index;
+        std::uint8_t family;
+        std::uint8_t prefixLength;
+        std::uint8_t scope;
+        in6_addr address;
+    };
+
+    InterfaceTable& interfaceList;
+    const InterfaceFilter& filter;
+    // Position of each interface in the table by ifindex, allocated along with the table
+    std::pmr::unordered_map<int, std::size_t> positionByIndex{interfaceList.resource()};
+    std::pmr::vector<HeldAddress> heldAddresses{interfaceList.resource()};
+    bool holdingAddresses{false};
+
+    // Hold the addresses, in the order they come, until linksComplete()
+    void deferAddresses() { holdingAddresses = true; }
+
+    // Add the held addresses to their interfaces now that every link is known
+    void linksComplete() {
+        holdingAddresses = false;
+        for (const HeldAddress& held : heldAddresses) {
+            addAddress(held.index, held.family, &held.address, held.prefixLength, held.scope);
+        }
+        heldAddresses.clear();
+    }
+
+    void link(const nlmsghdr* message) {
+        if (message->nlmsg_type != RTM_NEWLINK) {
+            return;
+        }
+        const auto* info{static_cast<const ifinfomsg*>(NLMSG_DATA(message))};
+        if (!filter.acceptsFlags(info->ifi_flags)) {
+            return;
+        }
+        const rtattr* attributes[IFLA_MAX + 1];
+        parseLinkAttributes(message, attributes);
+        if (attributes[IFLA_IFNAME] == nullptr || !filter.acceptsLinkType(linkKind(attributes), info->ifi_type)) {
+            return;
+        }
+        positionByIndex.emplace(info->ifi_index, interfaceList.size());
+        interfaceList.add(static_cast<const char*>(RTA_DATA(attributes[IFLA_IFNAME])), info->ifi_index,
+                          info->ifi_flags);
+        if (interfaceList.keepsLinkAttributes()) {
+            keepLinkAttributes(attributes);
+        }
+    }
+
+    // Attach the attributes output may ask for to the new interface, still encoded; only the printed ones are decoded
+    void keepLinkAttributes(const rtattr* const* attributes) {
+        alignas(rtattr) char kept[RTA_SPACE(LINK_ADDRESS_MAX) + RTA_SPACE(sizeof(std::uint32_t)) +
+                                  RTA_SPACE(sizeof(std::uint8_t))]{};
+        std::size_t size{0};
+        for (int type : {IFLA_ADDRESS, IFLA_MTU, IFLA_OPERSTATE}) {
+            const rtattr* attribute{attributes[type]};
+            if (attribute != nullptr && size + RTA_ALIGN(attribute->rta_len) <= sizeof(kept)) {
+                std::memcpy(kept + size, attribute, attribute->rta_len);
+                size += RTA_ALIGN(attribute->rta_len);
+            }
+        }
+        interfaceList.setLinkAttributes(kept, size);
+    }
+
+    void address(const nlmsghdr* message) {
+        if (message->nlmsg_type != RTM_NEWADDR) {
+            return;
+        }
+        const auto* info{static_cast<const ifaddrmsg*>(NLMSG_DATA(message))};
+        if ((info->ifa_family != AF_INET && info->ifa_family != AF_INET6) || !filter.acceptsFamily(info->ifa_family)) {
+            return;
+        }
+
+        // IFA_LOCAL is the interface's own address; IFA_ADDRESS is the peer on point-to-point links
+        const rtattr* attributes[IFA_MAX + 1];
+        parseAddressAttributes(message, attributes);
+        const rtattr* address{attributes[IFA_LOCAL] ? attributes[IFA_LOCAL] : attributes[IFA_ADDRESS]};
+        if (address == nullptr) {
+            return;
+        }
+        int index{static_cast<int>(info->ifa_index)};
+        if (holdingAddresses) {
+            HeldAddress& held{heldAddresses.emplace_back()};
+            held = HeldAddress{index, info->ifa_family, info->ifa_prefixlen, info->ifa_scope, {}};
+            std::memcpy(&held.address, RTA_DATA(address), info->ifa_family == AF_INET6 ? sizeof(in6_addr)
+                                                                                         : sizeof(in_addr));
+            return;
+        }
+        addAddress(index, info->ifa_family, RTA_DATA(address), info->ifa_prefixlen, info->ifa_scope);
+    }
+
+    // Function to add an address to the interface with that index, if it was accepted
+    void addAddress(int index, int family, const void* address, std::uint8_t prefixLength, std::uint8_t scope) {
+        auto position{positionByIndex.find(index)};
+        if (position != positionByIndex.end()) {
+            interfaceList.addAddress(position->second, family, address, prefixLength, scope);
+        }
+    }
+
+    void finish() { interfaceList.finish(); }
+};
+
+/*
+ * Fill the interface table using rtnetlink: an RTM_GETLINK dump for the names and an RTM_GETADDR dump for the
+ * addresses of every family (or only the filtered one). Both are sent at once on two sockets and received as their
+ * replies come in, so that the kernel builds the first datagrams of both while the other is being read; the
+ * addresses are joined to their links by ifindex once the link dump is complete.
+ * Returns false if netlink is unavailable, so the caller can fall back to another method.
+ */
+inline bool dumpWithNetlink(InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    NetlinkSocket linkSocket{interfaceList.resource()};
+    NetlinkSocket addressSocket{interfaceList.resource()};
+    if (!linkSocket.open() || !addressSocket.open()) {
+        return false;
+    }
+    linkSocket.enableStrictCheck();
+    addressSocket.enableStrictCheck();
+    NetlinkTableBuilder builder{interfaceList, filter};
+    builder.deferAddresses();
+
+    NetlinkRequest linkRequest{makeLinkDumpRequest(filter)};
+    NetlinkRequest addressRequest{makeAddressDumpRequest(filter)};
+    if (!linkSocket.send(linkRequest) || !addressSocket.send(addressRequest)) {
+        return false;
+    }
+
+    bool linksDone{false};
+    bool addressesDone{false};
+    while (!linksDone || !addressesDone) {
+        pollfd sockets[2]{{linkSocket.descriptor(), static_cast<short>(linksDone ? 0 : POLLIN), 0},
+                          {addressSocket.descriptor(), static_cast<short>(addressesDone ? 0 : POLLIN), 0}};
+        if (poll(sockets, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (sockets[0].revents != 0) {
+            if (!linkSocket.receiveSome([&](const nlmsghdr* message) { builder.link(message); }, linksDone)) {
+                return false;
+            }
+            if (linksDone) {
+                builder.linksComplete();
+            }
+        }
+        if (sockets[1].revents != 0 &&
+            !addressSocket.receiveSome([&](const nlmsghdr* message) { builder.address(message); }, addressesDone)) {
+            return false;
+        }
+    }
+    builder.finish();
+    return true;
+}
+
+// Function to fill the interface table with dumpWithNetlink(), again if a datagram did not fit in the receive slots
+inline bool enumerateWithNetlink(InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    return retryOnLargeDatagram([&]() {
+        interfaceList.clear();
+        return dumpWithNetlink(interfaceList, filter);
+    });
+}
+
+/*
+ * Fill the interface table with a single interface, looked up by name, without dumping every link.
+ * - The index comes from if_nametoindex(); the link itself is fetched with a non-dump RTM_GETLINK for that index.
+ * - The RTM_GETADDR dump carries ifa_index on a NETLINK_GET_STRICT_CHK socket, so the kernel only walks and returns
+ *   that interface's addresses. Kernels without strict checking (before 4.20) ignore the index and dump everything;
+ *   the builder then drops the addresses of other interfaces.
+ * The cost is independent of the number of interfaces on the host. An unknown name leaves the table empty.
+ */
+inline bool lookUpOneWithNetlink(InterfaceTable& interfaceList, const char* name, const InterfaceFilter& filter) {
+    unsigned int index{if_nametoindex(name)};
+    if (index == 0) {
+        return true;
+    }
+
+    NetlinkSocket socket{interfaceList.resource()};
+    if (!socket.open()) {
+        return false;
+    }
+    socket.enableStrictCheck();
+    NetlinkTableBuilder builder{interfaceList, filter};
+
+    ifinfomsg linkRequestInfo{};
+    linkRequestInfo.ifi_family = AF_UNSPEC;
+    linkRequestInfo.ifi_index = static_cast<int>(index);
+    NetlinkRequest linkRequest{RTM_GETLINK, NLM_F_REQUEST, &linkRequestInfo, sizeof(linkRequestInfo)};
+    if (!socket.send(linkRequest) || !socket.receive([&](const nlmsghdr* message) { builder.link(message); })) {
+        // The interface may have been removed since if_nametoindex()
+        return socket.error() == ENODEV;
+    }
+
+    NetlinkRequest addressRequest{makeAddressDumpRequest(filter, index)};
+    bool received{socket.send(addressRequest) &&
+                  socket.receive([&](const nlmsghdr* message) { builder.address(message); })};
+    builder.finish();
+    return received;
+}
+
+// Function to fill the interface table with lookUpOneWithNetlink(), again if a reply did not fit in the receive slots
+inline bool enumerateOneWithNetlink(InterfaceTable& interfaceList, const char* name, const InterfaceFilter& filter) {
+    return retryOnLargeDatagram([&]() {
+        interfaceList.clear();
+        return lookUpOneWithNetlink(interfaceList, name, filter);
+    });
+}
+
+// Result of a route lookup
+struct RouteLookup {
+    int index{0};           // RTA_OIF: interface the kernel would send through
+    bool hasSource{false};  // Whether the route has a preferred source address
+    AddressRecord source{}; // RTA_PREFSRC: address the kernel would use as source (prefix length unknown, 0)
+};
+
+/*
+ * Ask the kernel how it would reach `destination` (an in_addr or in6_addr), with one non-dump RTM_GETROUTE.
+ * Returns false if the request failed or the destination is unreachable (error() tells why, e.g. ENETUNREACH).
+ */
+inline bool lookupRouteWithNetlink(NetlinkSocket& socket, int family, const void* destination, RouteLookup& route) {
+    std::size_t size{family == AF_INET6 ? sizeof(in6_addr) : sizeof(in_addr)};
+    rtmsg info{};
+    info.rtm_family = static_cast<unsigned char>(family);
+    info.rtm_dst_len = static_cast<unsigned char>(size * 8);
+    NetlinkRequest request{RTM_GETROUTE, NLM_F_REQUEST, &info, sizeof(info)};
+    request.addAttribute(RTA_DST, destination, size);
+
+    route = RouteLookup{};
+    bool received{socket.send(request) && socket.receive([&](const nlmsghdr* message) {
+        if (message->nlmsg_type != RTM_NEWROUTE) {
+            return;
+        }
+        const auto* reply{static_cast<const rtmsg*>(NLMSG_DATA(message))};
+        const rtattr* attributes[RTA_MAX + 1];
+        parseAttributes(RTM_RTA(reply), RTM_PAYLOAD(message), attributes, RTA_MAX);
+        if (attributes[RTA_OIF] != nullptr) {
+            std::memcpy(&route.index, RTA_DATA(attributes[RTA_OIF]), sizeof(route.index));
+        }
+        if (attributes[RTA_PREFSRC] != nullptr && RTA_PAYLOAD(attributes[RTA_PREFSRC]) == size) {
+            route.hasSource = true;
+            route.source.family = static_cast<std::uint8_t>(family);
+            std::memcpy(&route.source.address, RTA_DATA(attributes[RTA_PREFSRC]), size);
+        }
+    })};
+    return received && route.index != 0;
+}
+
+/*
+ * Fill the interface table with the interface the kernel would use to reach `destination`: one RTM_GETROUTE for the
+ * outgoing interface and preferred source address, then one non-dump RTM_GETLINK for that interface's name and flags.
+ * The preferred source address, if the route has one, is the interface's only address in the table (as a host
+ * address). An unreachable destination leaves the table empty.
+ */
+inline bool lookUpRouteWithNetlink(InterfaceTable& interfaceList, int family, const void* destination,
+                                   const InterfaceFilter& filter, RouteLookup& route) {
+    NetlinkSocket socket{interfaceList.resource()};
+    if (!socket.open()) {
+        return false;
+    }
+    if (!lookupRouteWithNetlink(socket, family, destination, route)) {
+        return socket.error() == ENETUNREACH || socket.error() == EHOSTUNREACH || socket.error() == 0;
+    }
+
+    NetlinkTableBuilder builder{interfaceList, filter};
+    ifinfomsg linkRequestInfo{};
+    linkRequestInfo.ifi_family = AF_UNSPEC;
+    linkRequestInfo.ifi_index = route.index;
+    NetlinkRequest linkRequest{RTM_GETLINK, NLM_F_REQUEST, &linkRequestInfo, sizeof(linkRequestInfo)};
+    if (!socket.send(linkRequest) || !socket.receive([&](const nlmsghdr* message) { builder.link(message); })) {
+        return socket.error() == ENODEV;
+    }
+    // The source is the only address in the table, and is filtered like those of an address dump
+    if (!interfaceList.empty() && route.hasSource && filter.acceptsFamily(family)) {
+        std::uint8_t hostLength{static_cast<std::uint8_t>(family == AF_INET6 ? 128 : 32)};
+        interfaceList.addAddress(0, family, &route.source.address, hostLength);
+    }
+    builder.finish();
+    return true;
+}
+
+// Function to fill the interface table with lookUpRouteWithNetlink(), again if a reply did not fit in the slots
+inline bool enumerateRouteWithNetlink(InterfaceTable& interfaceList, int family, const void* destination,
+                                      const InterfaceFilter& filter, RouteLookup& route) {
+    return retryOnLargeDatagram([&]() {
+        interfaceList.clear();
+        return lookUpRouteWithNetlink(interfaceList, family, destination, filter, route);
+    });
+}
+
+#endif // IFACEPICKER_NETLINK_HPP
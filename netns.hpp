@@ -0,0 +1,178 @@
+/*
+ * netns.hpp - Enumeration across every network namespace of the host (--all-netns).
+ *
+ * Namespaces are discovered from the names bound under /run/netns (as `ip netns add` does) and from /proc/PID/ns/net
+ * of every running process; the same namespace reached through several paths is only enumerated once (namespaces are
+ * identified by the device and inode of their nsfs file). A pool of worker threads, one per core, takes namespaces
+ * from a shared counter: each worker setns()'s itself into the namespace, which only affects that thread, and
+ * does a netlink dump there. The per-namespace tables are then merged, in discovery order, into one table whose
+ * records are tagged with their namespace.
+ */
+
+#ifndef IFACEPICKER_NETNS_HPP
+#define IFACEPICKER_NETNS_HPP
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "console.hpp"
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "netlink.hpp"
+
+// Directory where `ip netns add` binds named namespaces
+constexpr const char* NETNS_RUN_DIRECTORY{"/run/netns"};
+
+// One network namespace to enumerate
+struct NetworkNamespace {
+    std::string name; // Name under /run/netns, or "pid:N" for a namespace only reachable through a process
+    std::string path; // File to open for setns()
+};
+
+/*
+ * The interfaces of several namespaces in one table.
+ * - namespaceOf: For each record of the table, its namespace's position in `namespaces`.
+ */
+struct NamespaceTable {
+    InterfaceTable interfaceList;
+    std::vector<NetworkNamespace> namespaces;
+    std::vector<std::uint32_t> namespaceOf;
+
+    const std::string& namespaceName(std::size_t position) const { return namespaces[namespaceOf[position]].name; }
+};
+
+// Function to list the namespaces of the host: named ones first (sorted by name), then those of processes by pid
+inline std::vector<NetworkNamespace> discoverNamespaces() {
+    std::vector<NetworkNamespace> namespaces;
+    std::set<std::pair<dev_t, ino_t>> seen;
+    auto addNamespace{[&](std::string name, std::string path) {
+        struct stat status;
+        if (stat(path.c_str(), &status) == 0 && seen.emplace(status.st_dev, status.st_ino).second) {
+            namespaces.push_back(NetworkNamespace{std::move(name), std::move(path)});
+        }
+    }};
+
+    std::vector<std::string> names;
+    if (DIR* directory{opendir(NETNS_RUN_DIRECTORY)}) {
+        while (const dirent* entry{readdir(directory)}) {
+            if (entry->d_name[0] != '.') {
+                names.emplace_back(entry->d_name);
+            }
+        }
+        closedir(directory);
+    }
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names) {
+        addNamespace(name, std::string{NETNS_RUN_DIRECTORY} + "/" + name);
+    }
+
+    std::vector<long> pids;
+    if (DIR* directory{opendir("/proc")}) {
+        while (const dirent* entry{readdir(directory)}) {
+            char* end{nullptr};
+            long pid{std::strtol(entry->d_name, &end, 10)};
+            if (*end == '\0' && pid > 0) {
+                pids.push_back(pid);
+            }
+        }
+        closedir(directory);
+    }
+    std::sort(pids.begin(), pids.end());
+    for (long pid : pids) {
+        // Processes of other users or that exited meanwhile cannot be stat()'ed and are skipped
+        addNamespace("pid:" + std::to_string(pid), "/proc/" + std::to_string(pid) + "/ns/net");
+    }
+    return namespaces;
+}
+
+/*
+ * Enter a namespace in the calling thread and enumerate its interfaces with netlink.
+ * Returns false with errno set if the namespace could not be entered or the dump failed.
+ */
+inline bool enumerateNamespace(const NetworkNamespace& networkNamespace, const InterfaceFilter& filter,
+                               InterfaceTable& interfaceList) {
+    DescriptorGuard guard{open(networkNamespace.path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (guard.fd < 0 || setns(guard.fd, CLONE_NEWNET) < 0) {
+        return false;
+    }
+    // The netlink socket is created after setns(), so it belongs to the namespace
+    return enumerateWithNetlink(interfaceList, filter);
+}
+
+/*
+ * Fill `result` with the interfaces of every namespace, enumerated in parallel.
+ * Namespaces that cannot be entered (e.g. without CAP_SYS_ADMIN) are reported on stderr and skipped; returns false
+ * only if no namespace could be enumerated at all.
+ */
+inline bool enumerateAllNamespaces(NamespaceTable& result, const InterfaceFilter& filter) {
+    result.namespaces = discoverNamespaces();
+    std::vector<InterfaceTable> tables(result.namespaces.size());
+    std::vector<int> errors(result.namespaces.size(), 0);
+
+    // setns() changes the namespace of the calling thread only, so every namespace is entered by a worker thread
+    std::atomic<std::size_t> next{0};
+    auto worker{[&] {
+        for (std::size_t i = next++; i < result.namespaces.size(); i = next++) {
+            if (!enumerateNamespace(result.namespaces[i], filter, tables[i])) {
+                errors[i] = errno != 0 ? errno : EIO;
+            }
+        }
+    }};
+    std::size_t workerCount{std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                  result.namespaces.size())};
+    std::vector<std::thread> workers;
+    for (std::size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (std::thread& thread : workers) {
+        thread.join();
+    }
+
+    std::size_t interfaceCount{0};
+    for (const InterfaceTable& table : tables) {
+        interfaceCount += table.size();
+    }
+    result.interfaceList.clear();
+    result.interfaceList.reserve(interfaceCount);
+    result.namespaceOf.clear();
+    result.namespaceOf.reserve(interfaceCount);
+
+    bool enumerated{false};
+    for (std::size_t i = 0; i < tables.size(); ++i) {
+        if (errors[i] != 0) {
+            errorMessage() << "Skipping namespace " << result.namespaces[i].name << ": " << std::strerror(errors[i])
+                           << '\n';
+            continue;
+        }
+        enumerated = true;
+        for (const InterfaceRecord& record : tables[i]) {
+            std::size_t position{result.interfaceList.size()};
+            result.interfaceList.add(record.nameView(), record.index, record.flags);
+            for (const AddressRecord& entry : tables[i].addresses(record)) {
+                result.interfaceList.addAddress(position, entry.family, &entry.address, entry.prefixLength,
+                                                entry.scope);
+            }
+            result.namespaceOf.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+    result.interfaceList.finish();
+    return enumerated;
+}
+
+#endif // IFACEPICKER_NETNS_HPP
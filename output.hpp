@@ -0,0 +1,435 @@
+/*
+ * output.hpp - Rendering of the results.
+ *
+ * Everything printed for one invocation is rendered into a single preallocated buffer and written with write(2),
+ * instead of being streamed line by line. Besides the interactive text, --format selects a machine-readable form:
+ *   env   IFACE=<name> and IPADDR=<address> lines (the default output after a selection); one block per interface,
+ *         separated by empty lines, when listing
+ *   json  One object per interface: {"name", "index", "up", "ip" (the selected address or null), "addresses"
+ *         (every address as address/prefix)}; an array of them when listing
+ *   tsv   <name>TAB<address> lines
+ *   nul   <name>NUL<address>NUL, for `xargs -0` and other consumers that cannot trust separators
+ *   image The binary table as a daemon reply (see appendDaemonReply), read back by fleet mode over ssh
+ * In the json, tsv and nul formats an interface without a selected address has null or an empty field instead of
+ * NO_IP_ADDRESS. With --all-netns each interface also carries its network namespace: a NETNS= line, a "netns" member
+ * or a first field. With --fields (see fields.hpp) the same formats carry the fields of the template instead, in its
+ * order: one <KEY>= line per field, an object with one member per field, or one column per field.
+ */
+
+#ifndef IFACEPICKER_OUTPUT_HPP
+#define IFACEPICKER_OUTPUT_HPP
+
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "fields.hpp"
+#include "interface_table.hpp"
+#include "timings.hpp"
+
+enum class OutputFormat { Text, Env, Json, Tsv, Nul, Image };
+
+// Rough size of the rendered text for one interface and for one address, used to size the output buffer
+constexpr std::size_t OUTPUT_INTERFACE_SIZE{96};
+constexpr std::size_t OUTPUT_ADDRESS_SIZE{64};
+
+// Function to parse the --format value; returns false if it is not a known format
+inline bool parseOutputFormat(const std::string& text, OutputFormat& format) {
+    if (text == "text") {
+        format = OutputFormat::Text;
+    } else if (text == "env") {
+        format = OutputFormat::Env;
+    } else if (text == "json") {
+        format = OutputFormat::Json;
+    } else if (text == "tsv") {
+        format = OutputFormat::Tsv;
+    } else if (text == "nul") {
+        format = OutputFormat::Nul;
+    } else if (text == "image") {
+        format = OutputFormat::Image;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to reserve enough room in `out` for rendering the whole table, so that it is allocated only once
+inline void reserveOutput(OutputBuffer& out, const InterfaceTable& interfaceList) {
+    out.reserve(out.size() + 128 + interfaceList.size() * OUTPUT_INTERFACE_SIZE +
+                interfaceList.addressTotal() * OUTPUT_ADDRESS_SIZE);
+}
+
+// Function to append a JSON string literal; interface names may contain quotes and other unusual characters
+inline void appendJsonString(OutputBuffer& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned char>(c));
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// Function to append the selected address(es) of an interface, or nothing; returns false if there was none
+inline bool appendAddressField(OutputBuffer& out, AddressRange addresses, const AddressSelector& selector) {
+    std::size_t length{out.size()};
+    appendSelectedAddresses(out, addresses, selector);
+    if (out.compare(length, std::string::npos, NO_IP_ADDRESS) == 0) {
+        out.resize(length);
+        return false;
+    }
+    return true;
+}
+
+// Function to append the value of one field of an interface; returns false, appending nothing, if it is unknown
+inline bool appendFieldValue(OutputBuffer& out, Field field, const InterfaceTable& interfaceList,
+                             const InterfaceRecord& record, const AddressSelector& selector, FieldTemplate& fields) {
+    switch (field) {
+    case Field::Name:
+        out += record.name;
+        return true;
+    case Field::Index:
+        out += std::to_string(record.index);
+        return true;
+    case Field::Ip:
+        return appendAddressField(out, selectableAddresses(interfaceList, record, selector), selector);
+    default:
+        return fields.appendLinkValue(out, field, interfaceList, record);
+    }
+}
+
+// Text written before a field's value, assembled at compile time (see the format policies' key())
+struct FieldKey {
+    char text[32]{};
+    std::size_t size{0};
+
+    constexpr void append(std::string_view part) {
+        for (char c : part) {
+            text[size++] = c;
+        }
+    }
+    constexpr std::string_view view() const { return std::string_view{text, size}; }
+};
+
+/*
+ * Format policies: what each --format writes around lists, interfaces and fields. The renderers below are templates
+ * over them, so that each format gets its own loop with the format resolved at compile time; the OutputFormat
+ * overloads pick the policy once per call (see withFormat), not once per interface or field.
+ * - key(): Written before a field's value: the separator from the previous field, then the name if the format has
+ *   one. The first field of an interface leaves out the first LEADING characters (the separator).
+ * - unknown(): Written instead of the value of an unknown field.
+ */
+struct EnvFormat {
+    static constexpr OutputFormat FORMAT{OutputFormat::Env};
+    static constexpr std::string_view LIST_START{""}, LIST_SEPARATOR{"\n"}, LIST_END{""};
+    static constexpr std::string_view RECORD_START{""}, FIELD_END{"\n"}, RECORD_END{""};
+    static constexpr std::size_t LEADING{0};
+    static constexpr bool QUOTES_TEXT{false};
+
+    static constexpr void key(FieldKey& key, const FieldNames& names) {
+        key.append(names.envKey);
+        key.append("=");
+    }
+    static constexpr std::string_view unknown(Field field) { return field == Field::Ip ? NO_IP_ADDRESS : ""; }
+    static void appendNamespace(OutputBuffer& out, std::string_view namespaceName) {
+        out += "NETNS=";
+        out += namespaceName;
+        out += '\n';
+    }
+};
+
+struct JsonFormat {
+    static constexpr OutputFormat FORMAT{OutputFormat::Json};
+    static constexpr std::string_view LIST_START{"["}, LIST_SEPARATOR{","}, LIST_END{"]\n"};
+    static constexpr std::string_view RECORD_START{"{"}, FIELD_END{""}, RECORD_END{"}"};
+    static constexpr std::size_t LEADING{1};
+    static constexpr bool QUOTES_TEXT{true}; // Addresses and link attributes never need escaping
+
+    static constexpr void key(FieldKey& key, const FieldNames& names) {
+        key.append(",\"");
+        key.append(names.name);
+        key.append("\":");
+    }
+    static constexpr std::string_view unknown(Field) { return "null"; }
+    static void appendNamespace(OutputBuffer& out, std::string_view namespaceName) {
+        out += "\"netns\":";
+        appendJsonString(out, namespaceName);
+    }
+};
+
+// tsv and nul: one column per field, SEPARATOR between them and TERMINATOR after the last
+template <OutputFormat KIND, char SEPARATOR_CHAR, char TERMINATOR_CHAR>
+struct SeparatedFormat {
+    static constexpr OutputFormat FORMAT{KIND};
+    static constexpr char CHARACTERS[]{SEPARATOR_CHAR, TERMINATOR_CHAR};
+    static constexpr std::string_view SEPARATOR{CHARACTERS, 1}, TERMINATOR{CHARACTERS + 1, 1};
+    static constexpr std::string_view LIST_START{""}, LIST_SEPARATOR{""}, LIST_END{""};
+    static constexpr std::string_view RECORD_START{""}, FIELD_END{""}, RECORD_END{TERMINATOR};
+    static constexpr std::size_t LEADING{1};
+    static constexpr bool QUOTES_TEXT{false};
+
+    static constexpr void key(FieldKey& key, const FieldNames&) { key.append(SEPARATOR); }
+    static constexpr std::string_view unknown(Field) { return ""; }
+    static void appendNamespace(OutputBuffer& out, std::string_view namespaceName) { out += namespaceName; }
+};
+using TsvFormat = SeparatedFormat<OutputFormat::Tsv, '\t', '\n'>;
+using NulFormat = SeparatedFormat<OutputFormat::Nul, '\0', '\0'>;
+
+// The body of a line of the interactive list ("Interface: eth0, IP: 192.0.2.1, MTU: 1500"); only for --fields
+struct TextFormat {
+    static constexpr OutputFormat FORMAT{OutputFormat::Text};
+    static constexpr std::string_view RECORD_START{""}, FIELD_END{""}, RECORD_END{""};
+    static constexpr std::size_t LEADING{2};
+    static constexpr bool QUOTES_TEXT{false};
+
+    static constexpr void key(FieldKey& key, const FieldNames& names) {
+        key.append(", ");
+        key.append(names.label);
+        key.append(": ");
+    }
+    static constexpr std::string_view unknown(Field field) { return field == Field::Ip ? NO_IP_ADDRESS : "unknown"; }
+    static void appendNamespace(OutputBuffer& out, std::string_view namespaceName) {
+        out += "Namespace: ";
+        out += namespaceName;
+    }
+};
+
+// Function to call render(Policy{}) with the policy of a format; nothing is rendered in OutputFormat::Image
+template <typename Render>
+inline void withFormat(OutputFormat format, Render&& render) {
+    switch (format) {
+    case OutputFormat::Env:
+        render(EnvFormat{});
+        break;
+    case OutputFormat::Json:
+        render(JsonFormat{});
+        break;
+    case OutputFormat::Tsv:
+        render(TsvFormat{});
+        break;
+    case OutputFormat::Nul:
+        render(NulFormat{});
+        break;
+    case OutputFormat::Text:
+        render(TextFormat{});
+        break;
+    case OutputFormat::Image:
+        break;
+    }
+}
+
+// What a field operation renders
+struct FieldContext {
+    const InterfaceTable& interfaceList;
+    const InterfaceRecord& record;
+    const AddressSelector& selector;
+    FieldTemplate& fields;
+};
+
+// Function to append the value of field FIELD in a format, or the format's placeholder if it is unknown
+template <typename Format, Field FIELD>
+inline void appendFieldOperation(OutputBuffer& out, const FieldContext& context) {
+    if constexpr (FIELD == Field::Name && Format::FORMAT == OutputFormat::Json) {
+        appendJsonString(out, context.record.nameView());
+    } else {
+        constexpr bool QUOTED{Format::QUOTES_TEXT && isTextField(FIELD)};
+        std::size_t length{out.size()};
+        if constexpr (QUOTED) {
+            out += '"';
+        }
+        if (appendFieldValue(out, FIELD, context.interfaceList, context.record, context.selector, context.fields)) {
+            if constexpr (QUOTED) {
+                out += '"';
+            }
+            return;
+        }
+        out.resize(length);
+        out += Format::unknown(FIELD);
+    }
+}
+
+// One step of a compiled field template: the key, then the value
+struct FieldOperation {
+    FieldKey key;
+    void (*append)(OutputBuffer&, const FieldContext&);
+};
+
+template <typename Format, std::size_t... FIELDS>
+constexpr std::array<FieldOperation, sizeof...(FIELDS)> makeFieldOperations(std::index_sequence<FIELDS...>) {
+    auto make{[](const FieldNames& names, auto append) {
+        FieldOperation operation{FieldKey{}, append};
+        Format::key(operation.key, names);
+        return operation;
+    }};
+    return {{make(FIELD_NAMES[FIELDS], &appendFieldOperation<Format, static_cast<Field>(FIELDS)>)...}};
+}
+
+// The operation of every field in a format, indexed by Field; a template is rendered by looking its fields up here
+template <typename Format>
+inline constexpr std::array<FieldOperation, FIELD_COUNT> FIELD_OPERATIONS{
+    makeFieldOperations<Format>(std::make_index_sequence<FIELD_COUNT>{})};
+
+// Function to append the fields of a template for one interface in a format
+template <typename Format>
+inline void appendInterfaceFields(OutputBuffer& out, const InterfaceTable& interfaceList,
+                                  const InterfaceRecord& record, const AddressSelector& selector,
+                                  std::string_view namespaceName, FieldTemplate& fields) {
+    out += Format::RECORD_START;
+    bool first{true};
+    if (!namespaceName.empty()) {
+        Format::appendNamespace(out, namespaceName);
+        first = false;
+    }
+    FieldContext context{interfaceList, record, selector, fields};
+    for (Field field : fields.fields()) {
+        const FieldOperation& operation{FIELD_OPERATIONS<Format>[static_cast<std::size_t>(field)]};
+        std::string_view key{operation.key.view()};
+        out += first ? key.substr(Format::LEADING) : key;
+        operation.append(out, context);
+        out += Format::FIELD_END;
+        first = false;
+    }
+    out += Format::RECORD_END;
+}
+
+/*
+ * Append the fields of a template for one interface, in any format but OutputFormat::Image. The text format is the
+ * body of a line of the interactive list ("Interface: eth0, IP: 192.0.2.1, MTU: 1500").
+ */
+inline void appendInterfaceFields(OutputBuffer& out, OutputFormat format, const InterfaceTable& interfaceList,
+                                  const InterfaceRecord& record, const AddressSelector& selector,
+                                  std::string_view namespaceName, FieldTemplate& fields) {
+    withFormat(format, [&](auto policy) {
+        appendInterfaceFields<decltype(policy)>(out, interfaceList, record, selector, namespaceName, fields);
+    });
+}
+
+// Function to append one interface in a format (nothing in the text format, which is the interactive list's)
+template <typename Format>
+inline void appendInterface(OutputBuffer& out, const InterfaceTable& interfaceList, const InterfaceRecord& record,
+                            const AddressSelector& selector, std::string_view namespaceName, FieldTemplate* fields) {
+    if (fields != nullptr && !fields->empty()) {
+        appendInterfaceFields<Format>(out, interfaceList, record, selector, namespaceName, *fields);
+        return;
+    }
+    AddressRange addresses{selectableAddresses(interfaceList, record, selector)};
+    if constexpr (Format::FORMAT == OutputFormat::Env) {
+        if (!namespaceName.empty()) {
+            Format::appendNamespace(out, namespaceName);
+        }
+        out += "IFACE=";
+        out += record.name;
+        out += "\nIPADDR=";
+        appendSelectedAddresses(out, addresses, selector);
+        out += '\n';
+    } else if constexpr (Format::FORMAT == OutputFormat::Tsv || Format::FORMAT == OutputFormat::Nul) {
+        if (!namespaceName.empty()) {
+            out += namespaceName;
+            out += Format::SEPARATOR;
+        }
+        out += record.name;
+        out += Format::SEPARATOR;
+        appendAddressField(out, addresses, selector);
+        out += Format::TERMINATOR;
+    } else if constexpr (Format::FORMAT == OutputFormat::Json) {
+        out += "{\"name\":";
+        appendJsonString(out, record.nameView());
+        if (!namespaceName.empty()) {
+            out += ',';
+            Format::appendNamespace(out, namespaceName);
+        }
+        out += ",\"index\":";
+        out += std::to_string(record.index);
+        out += record.isUp() ? ",\"up\":true,\"ip\":" : ",\"up\":false,\"ip\":";
+        std::size_t length{out.size()};
+        out += '"';
+        if (appendAddressField(out, addresses, selector)) {
+            out += '"';
+        } else {
+            out.resize(length);
+            out += "null";
+        }
+        out += ",\"addresses\":[";
+        char text[ADDRESS_TEXT_SIZE];
+        for (std::size_t i = 0; i < addresses.size(); ++i) {
+            out += i == 0 ? "\"" : ",\"";
+            out += formatAddress(addresses[i], text);
+            out += '/';
+            out += std::to_string(addresses[i].prefixLength);
+            out += '"';
+        }
+        out += "]}";
+    }
+}
+
+/*
+ * Append one interface in a machine-readable format (not OutputFormat::Text or OutputFormat::Image).
+ * - namespaceName: Network namespace of the interface, or empty when only the current namespace is listed.
+ * - fields: Template of the output (--fields), or null for the default fields of each format.
+ */
+inline void appendInterface(OutputBuffer& out, OutputFormat format, const InterfaceTable& interfaceList,
+                            const InterfaceRecord& record, const AddressSelector& selector,
+                            std::string_view namespaceName = {}, FieldTemplate* fields = nullptr) {
+    if (format == OutputFormat::Text) {
+        return;
+    }
+    withFormat(format, [&](auto policy) {
+        appendInterface<decltype(policy)>(out, interfaceList, record, selector, namespaceName, fields);
+    });
+}
+
+/*
+ * Append every interface of the table in a machine-readable format (not OutputFormat::Text or OutputFormat::Image).
+ * - namespaceOf: Called with the position of each interface in the table; returns its namespace name or empty.
+ */
+template <typename NamespaceOf>
+inline void appendInterfaceList(OutputBuffer& out, OutputFormat format, const InterfaceTable& interfaceList,
+                                const AddressSelector& selector, NamespaceOf&& namespaceOf,
+                                FieldTemplate* fields = nullptr) {
+    withFormat(format, [&](auto policy) {
+        using Format = decltype(policy);
+        if constexpr (Format::FORMAT != OutputFormat::Text) {
+            out += Format::LIST_START;
+            for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+                if (i > 0) {
+                    out += Format::LIST_SEPARATOR;
+                }
+                appendInterface<Format>(out, interfaceList, interfaceList[i], selector, namespaceOf(i), fields);
+            }
+            out += Format::LIST_END;
+        }
+    });
+}
+
+// Function to write a whole buffer to a descriptor; a single write(2) unless the descriptor accepts less at once
+inline bool writeOutput(int fd, const OutputBuffer& out) {
+    const char* data{out.data()};
+    std::size_t size{out.size()};
+    while (size > 0) {
+        ssize_t written{write(fd, data, size)};
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+        timings().count(Counter::OutputBytes, static_cast<std::uint64_t>(written));
+    }
+    return true;
+}
+
+#endif // IFACEPICKER_OUTPUT_HPP
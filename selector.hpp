@@ -0,0 +1,250 @@
+/*
+ * selector.hpp - Non-interactive interface selection.
+ *
+ * A selector picks one interface from the table without listing it or prompting on stdin:
+ *   --iface NAME    The interface with that exact name
+ *   --index N       The N-th interface of the list (the number the prompt would ask for)
+ *   --first-up      The first interface that is up with carrier, skipping loopback devices
+ *   --match GLOB    The first interface whose name matches a shell glob (e.g. 'eth*', 'enp?s0')
+ *   --numa-local    The fastest interface whose device is attached to the NUMA node of the CPU ifacepicker runs on
+ *                   (run it pinned as the service will be, e.g. under numactl), or to the node given with =NODE
+ *   --least-loaded  The interface with the lowest utilisation over a short interval (see load.hpp)
+ *   --owner-of A[/P]  The interface configured with that address, or on the longest network containing it (or the
+ *                   whole prefix A/P)
+ * Batch mode (see batch.hpp) additionally selects by route destination: the interface the kernel would use to reach
+ * an address. Route and --least-loaded selectors are resolved to an interface index before findInterface() is called.
+ * Given an InterfaceIndex (see table_index.hpp), lookups by name, index and address take constant time.
+ */
+
+#ifndef IFACEPICKER_SELECTOR_HPP
+#define IFACEPICKER_SELECTOR_HPP
+
+#include <arpa/inet.h>
+#include <fnmatch.h>
+#include <netinet/in.h>
+
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "interface_table.hpp"
+#include "sysfs.hpp"
+#include "sysfs_batch.hpp"
+#include "table_index.hpp"
+
+struct InterfaceSelector {
+    enum class Kind { Prompt, Name, Position, FirstUp, Match, Route, NumaLocal, LeastLoaded, OwnerOf };
+
+    Kind kind{Kind::Prompt};      // Prompt: no selector given, list the interfaces and ask
+    std::string value;            // Name, glob, route destination or owned address
+    std::size_t position{0};      // 1-based position for Kind::Position
+    int index{0};                 // Kernel interface index for Kind::Route and Kind::LeastLoaded, once resolved
+    bool hasSource{false};        // Whether a Kind::Route selector resolved to a preferred source address...
+    AddressRecord source{};       // ... which is this one; a batch shows it as the address, as --route-to does
+    long numaNode{SYSFS_UNKNOWN}; // NUMA node for Kind::NumaLocal; the caller's own node once resolved
+};
+
+// Function to parse the optional node given to --numa-local; an empty text is the caller's node
+inline bool parseNumaSelector(const std::string& text, InterfaceSelector& selector) {
+    selector.kind = InterfaceSelector::Kind::NumaLocal;
+    selector.value = text;
+    selector.numaNode = SYSFS_UNKNOWN;
+    if (text.empty()) {
+        return true;
+    }
+    char* end{nullptr};
+    unsigned long node{std::strtoul(text.c_str(), &end, 10)};
+    if (*end != '\0' || text[0] == '-') {
+        return false;
+    }
+    selector.numaNode = static_cast<long>(node);
+    return true;
+}
+
+/*
+ * Find the interface for --numa-local: among the interfaces whose device is on the selector's NUMA node, the one with
+ * the highest link speed (links that are down have none), the first listed on a tie. Devices without NUMA affinity
+ * (numa_node -1, e.g. on single-node hosts) are equally close to every node and are only chosen when no device is on
+ * the node. The numa_node of every interface is read at once (see sysfs_batch.hpp), the speed only of those that have
+ * a device.
+ */
+inline std::size_t findNumaLocalInterface(const InterfaceTable& interfaceList, long node) {
+    SysfsAttributes attributes{interfaceList};
+    attributes.collect(sysfsAttributeBit(SysfsAttribute::NumaNode));
+    if (!attributes.has(SysfsAttribute::NumaNode)) {
+        return NO_INTERFACE;
+    }
+    std::size_t best{NO_INTERFACE};
+    bool bestOnNode{false};
+    long bestSpeed{SYSFS_UNKNOWN};
+    std::string_view value;
+    for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+        const InterfaceRecord& record{interfaceList[i]};
+        // Virtual interfaces have no device, hence no numa_node
+        if (!attributes.value(i, SysfsAttribute::NumaNode, value)) {
+            continue;
+        }
+        long interfaceNode{attributes.number(i, SysfsAttribute::NumaNode)};
+        bool onNode{interfaceNode == node};
+        if (!onNode && interfaceNode >= 0) {
+            continue;
+        }
+        long speed{readLinkSpeed(record.name)};
+        if (best == NO_INTERFACE || (onNode && !bestOnNode) || (onNode == bestOnNode && speed > bestSpeed)) {
+            best = i;
+            bestOnNode = onNode;
+            bestSpeed = speed;
+        }
+    }
+    return best;
+}
+
+// Function to resolve a --numa-local selector without a node to the node of the calling thread's CPU
+inline void resolveNumaSelector(InterfaceSelector& selector) {
+    if (selector.kind == InterfaceSelector::Kind::NumaLocal && selector.numaNode == SYSFS_UNKNOWN) {
+        selector.numaNode = currentNumaNode();
+    }
+}
+
+// Function to parse the 1-based position given to --index; returns false if it is not a positive number
+inline bool parsePositionSelector(const std::string& text, InterfaceSelector& selector) {
+    char* end{nullptr};
+    unsigned long position{std::strtoul(text.c_str(), &end, 10)};
+    if (text.empty() || *end != '\0' || position == 0) {
+        return false;
+    }
+    selector.kind = InterfaceSelector::Kind::Position;
+    selector.position = position;
+    return true;
+}
+
+// Function to parse the address (and optional prefix) given to --owner-of; returns false if it is not one
+inline bool parseOwnerSelector(const std::string& text, InterfaceSelector& selector) {
+    AddressPrefix prefix;
+    if (!parseAddressPrefix(text, prefix)) {
+        return false;
+    }
+    selector.kind = InterfaceSelector::Kind::OwnerOf;
+    selector.value = text;
+    return true;
+}
+
+/*
+ * Parse one selector of a batch: an IPv4/IPv6 address is a route destination, an address with a /prefix is an owned
+ * address (as --owner-of), a number is a position, a word with shell glob characters is a glob, and anything else is
+ * an interface name. Returns false for an empty selector.
+ */
+inline bool parseBatchSelector(const std::string& text, InterfaceSelector& selector) {
+    selector = InterfaceSelector{};
+    selector.value = text;
+    in6_addr address;
+    if (text.empty()) {
+        return false;
+    } else if (inet_pton(AF_INET, text.c_str(), &address) == 1 || inet_pton(AF_INET6, text.c_str(), &address) == 1) {
+        selector.kind = InterfaceSelector::Kind::Route;
+    } else if (text.find('/') != std::string::npos && parseOwnerSelector(text, selector)) {
+        return true;
+    } else if (text.find_first_not_of("0123456789") == std::string::npos) {
+        return parsePositionSelector(text, selector);
+    } else if (text.find_first_of("*?[") != std::string::npos) {
+        selector.kind = InterfaceSelector::Kind::Match;
+    } else {
+        selector.kind = InterfaceSelector::Kind::Name;
+    }
+    return true;
+}
+
+/*
+ * Find the position in the table of the interface chosen by a selector, or NO_INTERFACE.
+ * - index: Index of the table for repeated lookups; without one, names and indexes are looked up by a scan and an
+ *   --owner-of selector indexes the addresses for this lookup only.
+ */
+inline std::size_t findInterface(const InterfaceTable& interfaceList, const InterfaceSelector& selector,
+                                 InterfaceIndex* index = nullptr) {
+    switch (selector.kind) {
+    case InterfaceSelector::Kind::Position:
+        return selector.position <= interfaceList.size() ? selector.position - 1 : NO_INTERFACE;
+    case InterfaceSelector::Kind::NumaLocal:
+        return findNumaLocalInterface(interfaceList, selector.numaNode);
+    case InterfaceSelector::Kind::OwnerOf: {
+        AddressPrefix prefix;
+        if (!parseAddressPrefix(selector.value, prefix)) {
+            return NO_INTERFACE;
+        }
+        if (index == nullptr) {
+            InterfaceIndex addresses{interfaceList};
+            return addresses.findOwner(prefix);
+        }
+        return index->findOwner(prefix);
+    }
+    case InterfaceSelector::Kind::Name:
+        if (index != nullptr) {
+            return index->findName(selector.value);
+        }
+        break;
+    case InterfaceSelector::Kind::Route:
+    case InterfaceSelector::Kind::LeastLoaded:
+        if (index != nullptr) {
+            return selector.index != 0 ? index->findIndex(selector.index) : NO_INTERFACE;
+        }
+        break;
+    default:
+        break;
+    }
+
+    for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+        const InterfaceRecord& record{interfaceList[i]};
+        switch (selector.kind) {
+        case InterfaceSelector::Kind::Name:
+            if (selector.value == record.name) {
+                return i;
+            }
+            break;
+        case InterfaceSelector::Kind::FirstUp:
+            if (record.isUp()) {
+                return i;
+            }
+            break;
+        case InterfaceSelector::Kind::Match:
+            if (fnmatch(selector.value.c_str(), record.name, 0) == 0) {
+                return i;
+            }
+            break;
+        case InterfaceSelector::Kind::Route:
+        case InterfaceSelector::Kind::LeastLoaded:
+            if (selector.index != 0 && selector.index == record.index) {
+                return i;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return NO_INTERFACE;
+}
+
+// Function to describe a selector in error messages
+inline std::string describeSelector(const InterfaceSelector& selector) {
+    switch (selector.kind) {
+    case InterfaceSelector::Kind::Name:
+        return "--iface " + selector.value;
+    case InterfaceSelector::Kind::Position:
+        return "--index " + std::to_string(selector.position);
+    case InterfaceSelector::Kind::FirstUp:
+        return "--first-up";
+    case InterfaceSelector::Kind::Match:
+        return "--match " + selector.value;
+    case InterfaceSelector::Kind::Route:
+        return "route to " + selector.value;
+    case InterfaceSelector::Kind::NumaLocal:
+        return "--numa-local=" + std::to_string(selector.numaNode);
+    case InterfaceSelector::Kind::LeastLoaded:
+        return "--least-loaded";
+    case InterfaceSelector::Kind::OwnerOf:
+        return "--owner-of " + selector.value;
+    default:
+        return "prompt";
+    }
+}
+
+#endif // IFACEPICKER_SELECTOR_HPP
@@ -0,0 +1,245 @@
+/*
+ * snapshot.hpp - Interface table shared through a memory-mapped file.
+ *
+ * The daemon publishes its unfiltered table image (see InterfaceTable::appendImage) into a file under /run after
+ * every change. Readers map the file and copy the image out without talking to the daemon, so a lookup costs an
+ * open(), fstat(), mmap() and one flock() probe instead of a socket round trip.
+ *
+ * File layout: a SnapshotHeader, then the image. Consistency is guaranteed by a sequence lock: the writer makes
+ * `sequence` odd, writes, then makes it even again; a reader that sees an odd value, or a different value after
+ * copying, retries. When an image outgrows the file, a larger file is written next to it and renamed over it, so
+ * mappings that are already open stay valid.
+ *
+ * The daemon holds an exclusive flock() on the file as long as it runs. A file that is not locked was left behind by
+ * a daemon that died, and its contents are ignored.
+ */
+
+#ifndef IFACEPICKER_SNAPSHOT_HPP
+#define IFACEPICKER_SNAPSHOT_HPP
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "timings.hpp"
+
+constexpr std::uint32_t SNAPSHOT_MAGIC{0x69667073}; // "ifps"
+constexpr std::uint32_t SNAPSHOT_VERSION{1};
+
+// Default snapshot path, overridden by the IFACEPICKER_SNAPSHOT environment variable or --snapshot
+constexpr const char* SNAPSHOT_PATH{"/run/ifacepicker.snapshot"};
+
+// Smallest file created for a snapshot, so that small changes in the table do not require a new file
+constexpr std::size_t SNAPSHOT_MINIMUM_SIZE{64 * 1024};
+
+// How many times a reader retries while the snapshot is being written before giving up
+constexpr int SNAPSHOT_READ_ATTEMPTS{1000};
+
+struct SnapshotHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::atomic<std::uint64_t> sequence; // Odd while the image is being written
+    std::uint64_t capacity;              // Bytes available for the image; fixed for the lifetime of the file
+    std::uint64_t size;                  // Bytes used by the current image
+};
+
+// Function to get the path of the snapshot file published by the daemon
+inline std::string& snapshotPath() {
+    static std::string path{std::getenv("IFACEPICKER_SNAPSHOT") != nullptr ? std::getenv("IFACEPICKER_SNAPSHOT")
+                                                                            : SNAPSHOT_PATH};
+    return path;
+}
+
+// Function to copy the interfaces of `source` matching the filter (and `name`, if not null) into `interfaceList`
+inline void copyFiltered(const InterfaceTable& source, const InterfaceFilter& filter, const char* name,
+                         InterfaceTable& interfaceList) {
+    for (const InterfaceRecord& record : source) {
+        if (!filter.acceptsFlags(record.flags) || (name != nullptr && std::strcmp(name, record.name) != 0)) {
+            continue;
+        }
+        std::size_t position{interfaceList.size()};
+        interfaceList.add(record.nameView(), record.index, record.flags);
+        for (const AddressRecord& entry : source.addresses(record)) {
+            if (filter.acceptsFamily(entry.family)) {
+                interfaceList.addAddress(position, entry.family, &entry.address, entry.prefixLength, entry.scope);
+            }
+        }
+    }
+    interfaceList.finish();
+}
+
+/*
+ * Read the interfaces matching the filter (or only `name`, if not null) from the snapshot published by a running
+ * daemon. Returns false, leaving the table empty, if there is no live snapshot; the caller then falls back to the
+ * other backends. Link types are not part of the image, so the filter must not have one.
+ */
+inline bool readSnapshot(InterfaceTable& interfaceList, const InterfaceFilter& filter, const char* name = nullptr) {
+    TimedPhase openPhase{Phase::Open};
+    DescriptorGuard guard{open(snapshotPath().c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat status;
+    if (guard.fd < 0 || fstat(guard.fd, &status) < 0 ||
+        static_cast<std::size_t>(status.st_size) < sizeof(SnapshotHeader)) {
+        return false;
+    }
+
+    // Taking a shared lock only succeeds if the daemon that holds the exclusive one is gone
+    if (flock(guard.fd, LOCK_SH | LOCK_NB) == 0) {
+        return false;
+    }
+
+    std::size_t mappedSize{static_cast<std::size_t>(status.st_size)};
+    void* mapping{mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, guard.fd, 0)};
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    openPhase.stop();
+    const auto* header{static_cast<const SnapshotHeader*>(mapping)};
+    const char* image{static_cast<const char*>(mapping) + sizeof(SnapshotHeader)};
+
+    bool loaded{false};
+    bool filtered{name != nullptr || filter.family != AF_UNSPEC || filter.upOnly};
+    InterfaceTable unfiltered;
+    InterfaceTable& target{filtered ? unfiltered : interfaceList};
+    if (header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+        header->capacity <= mappedSize - sizeof(SnapshotHeader)) {
+        for (int attempt = 0; attempt < SNAPSHOT_READ_ATTEMPTS && !loaded; ++attempt) {
+            std::uint64_t sequence{header->sequence.load(std::memory_order_acquire)};
+            if (sequence & 1) {
+                continue;
+            }
+            std::uint64_t size{header->size};
+            bool valid{size <= header->capacity && target.loadImage(image, size)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            loaded = valid && header->sequence.load(std::memory_order_relaxed) == sequence;
+            timings().count(Counter::BytesRead, size);
+        }
+    }
+    munmap(mapping, mappedSize);
+
+    if (!loaded) {
+        target.clear();
+        return false;
+    }
+    if (filtered) {
+        copyFiltered(unfiltered, filter, name, interfaceList);
+    }
+    return true;
+}
+
+/*
+ * Writer side, owned by the daemon.
+ * - publish(): Replaces the published image; returns false (with errno set) if the file could not be written.
+ * The file is removed when the publisher is destroyed.
+ */
+class SnapshotPublisher {
+public:
+    explicit SnapshotPublisher(std::string path) : filePath{std::move(path)} {}
+
+    ~SnapshotPublisher() {
+        if (mapping != nullptr) {
+            unlink(filePath.c_str());
+            release();
+        }
+    }
+
+    SnapshotPublisher(const SnapshotPublisher&) = delete;
+    SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+    bool publish(std::string_view image) {
+        if (mapping == nullptr || image.size() > header()->capacity) {
+            return create(image);
+        }
+
+        SnapshotHeader* current{header()};
+        std::uint64_t sequence{current->sequence.load(std::memory_order_relaxed)};
+        current->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(data(), image.data(), image.size());
+        current->size = image.size();
+        current->sequence.store(sequence + 2, std::memory_order_release);
+        return true;
+    }
+
+    const std::string& path() const { return filePath; }
+
+private:
+    SnapshotHeader* header() { return static_cast<SnapshotHeader*>(mapping); }
+    char* data() { return static_cast<char*>(mapping) + sizeof(SnapshotHeader); }
+
+    void release() {
+        munmap(mapping, mappedSize);
+        close(fd);
+        mapping = nullptr;
+        fd = -1;
+    }
+
+    // Write the image to a new, large enough file and rename it over the published one
+    bool create(std::string_view image) {
+        std::size_t capacity{SNAPSHOT_MINIMUM_SIZE};
+        while (capacity < image.size() * 2) {
+            capacity *= 2;
+        }
+
+        // mkstemp() creates the file exclusively: a name planted beforehand (e.g. a symlink, if the snapshot is put in
+        // a shared directory) is never written through. Every client may read it, like the socket
+        std::string temporaryPath{filePath + ".XXXXXX"};
+        int newFd{mkostemp(temporaryPath.data(), O_CLOEXEC)};
+        if (newFd < 0) {
+            return false;
+        }
+        std::size_t newSize{sizeof(SnapshotHeader) + capacity};
+        void* newMapping{MAP_FAILED};
+        if (fchmod(newFd, 0644) == 0 && flock(newFd, LOCK_EX | LOCK_NB) == 0 &&
+            ftruncate(newFd, static_cast<off_t>(newSize)) == 0) {
+            newMapping = mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, newFd, 0);
+        }
+        if (newMapping == MAP_FAILED) {
+            int error{errno};
+            close(newFd);
+            unlink(temporaryPath.c_str());
+            errno = error;
+            return false;
+        }
+
+        new (newMapping) SnapshotHeader{SNAPSHOT_MAGIC, SNAPSHOT_VERSION, {0}, capacity, image.size()};
+        std::memcpy(static_cast<char*>(newMapping) + sizeof(SnapshotHeader), image.data(), image.size());
+        if (rename(temporaryPath.c_str(), filePath.c_str()) < 0) {
+            int error{errno};
+            munmap(newMapping, newSize);
+            close(newFd);
+            unlink(temporaryPath.c_str());
+            errno = error;
+            return false;
+        }
+
+        // Readers that still map the old file keep a consistent (if outdated) image
+        if (mapping != nullptr) {
+            release();
+        }
+        mapping = newMapping;
+        mappedSize = newSize;
+        fd = newFd;
+        return true;
+    }
+
+    std::string filePath;
+    int fd{-1};             // Kept open to hold the flock() that tells readers the daemon is alive
+    void* mapping{nullptr};
+    std::size_t mappedSize{0};
+};
+
+#endif // IFACEPICKER_SNAPSHOT_HPP
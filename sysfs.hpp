@@ -0,0 +1,140 @@
+/*
+ * sysfs.hpp - Attributes of network interfaces in /sys/class/net.
+ *
+ * What neither the enumeration nor the table carries (the link speed, the NUMA node of the device...) is read from
+ * /sys/class/net/<name>/ one small file at a time, so only for the interfaces that need it. Virtual interfaces have no
+ * device/ directory, and drivers that do not know an attribute fail the read(2): both mean unknown. The driver is the
+ * name of the device/driver symlink, which one readlink(2) gives.
+ */
+
+#ifndef IFACEPICKER_SYSFS_HPP
+#define IFACEPICKER_SYSFS_HPP
+
+#include <fcntl.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#include "descriptor.hpp"
+#include "timings.hpp"
+
+// Returned for a NUMA node or a speed that is unknown
+constexpr long SYSFS_UNKNOWN{-1};
+
+// Function to read an attribute of an interface, NUL-terminated and without its newline; false if unreadable or empty
+inline bool readInterfaceAttribute(std::string_view interfaceName, const char* attribute, char* buffer,
+                                   std::size_t size, std::string_view& value) {
+    char path[64 + IFNAMSIZ];
+    std::snprintf(path, sizeof(path), "/sys/class/net/%.*s/%s", static_cast<int>(interfaceName.size()),
+                  interfaceName.data(), attribute);
+    timings().count(Counter::SysfsFiles);
+    DescriptorGuard guard{open(path, O_RDONLY | O_CLOEXEC)};
+    if (guard.fd < 0) {
+        timings().count(Counter::SysfsSyscalls);
+        return false;
+    }
+    timings().count(Counter::SysfsSyscalls, 3);
+    ssize_t length{read(guard.fd, buffer, size - 1)};
+    if (length <= 0) {
+        return false;
+    }
+    while (length > 0 && (buffer[length - 1] == '\n' || buffer[length - 1] == ' ')) {
+        --length;
+    }
+    buffer[length] = '\0';
+    value = std::string_view{buffer, static_cast<std::size_t>(length)};
+    return !value.empty();
+}
+
+// Function to read the name a symlink attribute of an interface points to (e.g. device/driver), NUL-terminated; false
+// if there is no such link
+inline bool readInterfaceLink(std::string_view interfaceName, const char* attribute, char* buffer, std::size_t size,
+                              std::string_view& value) {
+    char path[64 + IFNAMSIZ];
+    std::snprintf(path, sizeof(path), "/sys/class/net/%.*s/%s", static_cast<int>(interfaceName.size()),
+                  interfaceName.data(), attribute);
+    timings().count(Counter::SysfsFiles);
+    timings().count(Counter::SysfsSyscalls);
+    ssize_t length{readlink(path, buffer, size - 1)};
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    const char* name{std::strrchr(buffer, '/')};
+    name = name != nullptr ? name + 1 : buffer;
+    value = std::string_view{name, static_cast<std::size_t>(buffer + length - name)};
+    return !value.empty();
+}
+
+// Function to read a numeric attribute of an interface; SYSFS_UNKNOWN if unreadable
+inline long readInterfaceNumber(std::string_view interfaceName, const char* attribute) {
+    char buffer[32];
+    std::string_view value;
+    if (!readInterfaceAttribute(interfaceName, attribute, buffer, sizeof(buffer), value)) {
+        return SYSFS_UNKNOWN;
+    }
+    char* end{nullptr};
+    long number{std::strtol(buffer, &end, 10)};
+    return *end == '\0' ? number : SYSFS_UNKNOWN;
+}
+
+// Function to ask the driver for the link speed with the ETHTOOL_GSET ioctl, where sysfs is not mounted
+inline long ethtoolSpeed(const char* interfaceName) {
+    DescriptorGuard guard{socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+    if (guard.fd < 0) {
+        return SYSFS_UNKNOWN;
+    }
+    ethtool_cmd command{};
+    command.cmd = ETHTOOL_GSET;
+    ifreq request{};
+    std::strncpy(request.ifr_name, interfaceName, IFNAMSIZ - 1);
+    request.ifr_data = reinterpret_cast<char*>(&command);
+    if (ioctl(guard.fd, SIOCETHTOOL, &request) < 0) {
+        return SYSFS_UNKNOWN;
+    }
+    std::uint32_t speed{ethtool_cmd_speed(&command)};
+    return speed == static_cast<std::uint32_t>(SPEED_UNKNOWN) ? SYSFS_UNKNOWN : static_cast<long>(speed);
+}
+
+// Function to map the speeds drivers report for "unknown" to SYSFS_UNKNOWN: SPEED_UNKNOWN is -1, or 0 or 65535 with
+// older drivers
+inline long knownLinkSpeed(long speed) {
+    return speed <= 0 || speed == 65535 ? SYSFS_UNKNOWN : speed;
+}
+
+// Function to get the link speed in Mb/s; SYSFS_UNKNOWN for links that are down and for most virtual devices
+inline long readLinkSpeed(const char* interfaceName) {
+    long speed{readInterfaceNumber(interfaceName, "speed")};
+    if (speed == SYSFS_UNKNOWN && access("/sys/class/net", F_OK) != 0) {
+        speed = ethtoolSpeed(interfaceName);
+    }
+    return knownLinkSpeed(speed);
+}
+
+// Function to get the NUMA node the interface's device is attached to; SYSFS_UNKNOWN without a device or affinity
+inline long readNumaNode(std::string_view interfaceName) {
+    long node{readInterfaceNumber(interfaceName, "device/numa_node")};
+    return node < 0 ? SYSFS_UNKNOWN : node;
+}
+
+// Function to get the NUMA node of the CPU the calling thread runs on; SYSFS_UNKNOWN if the kernel does not tell
+inline long currentNumaNode() {
+    unsigned int cpu;
+    unsigned int node;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) {
+        return SYSFS_UNKNOWN;
+    }
+    return static_cast<long>(node);
+}
+
+#endif // IFACEPICKER_SYSFS_HPP
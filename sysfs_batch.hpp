@@ -0,0 +1,164 @@
+/*
+ * sysfs_batch.hpp - Attributes of every interface of a table, read from sysfs at once.
+ *
+ * Listing the speed, duplex, carrier, driver or NUMA node of 10k interfaces reads as many sysfs files, each with an
+ * open(2), a read(2) and a close(2) (a readlink(2) for the driver), and most of the time goes into the kernel's path
+ * walk. A SysfsAttributes reads the attributes a run needs for the whole table before it is printed, each interface's
+ * files one after the other, with a pool of worker threads (one per core, as for --all-netns) taking
+ * SYSFS_BATCH_INTERFACES interfaces at a time from a shared counter. Tables too small for a second worker to pay off
+ * are read in the calling thread. The values are kept per table position, for the fields (see fields.hpp) and
+ * --numa-local to look up instead of reading the files again.
+ */
+
+#ifndef IFACEPICKER_SYSFS_BATCH_HPP
+#define IFACEPICKER_SYSFS_BATCH_HPP
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "interface_table.hpp"
+#include "sysfs.hpp"
+
+// The attributes that can be collected, and the file each is read from in /sys/class/net/<name>/
+enum class SysfsAttribute { Speed, NumaNode, LocalCpus, Address, Mtu, Operstate, Duplex, Carrier, Driver };
+constexpr const char* SYSFS_ATTRIBUTE_FILES[]{"speed",     "device/numa_node", "device/local_cpulist",
+                                              "address",   "mtu",              "operstate",
+                                              "duplex",    "carrier",          "device/driver"};
+constexpr std::size_t SYSFS_ATTRIBUTE_COUNT{std::size(SYSFS_ATTRIBUTE_FILES)};
+
+// Function to read one attribute of an interface: the driver is a symlink, the others are files
+inline bool readSysfsAttribute(std::string_view interfaceName, SysfsAttribute attribute, char* buffer, std::size_t size,
+                               std::string_view& value) {
+    const char* file{SYSFS_ATTRIBUTE_FILES[static_cast<std::size_t>(attribute)]};
+    return attribute == SysfsAttribute::Driver ? readInterfaceLink(interfaceName, file, buffer, size, value)
+                                               : readInterfaceAttribute(interfaceName, file, buffer, size, value);
+}
+
+// Function to get the bit of an attribute in a set of them, as given to SysfsAttributes::collect()
+constexpr unsigned int sysfsAttributeBit(SysfsAttribute attribute) {
+    return 1u << static_cast<unsigned int>(attribute);
+}
+
+// Interfaces a worker takes at once, and the fewest worth starting another worker thread for
+constexpr std::size_t SYSFS_BATCH_INTERFACES{64};
+constexpr std::size_t SYSFS_INTERFACES_PER_WORKER{256};
+
+// The most read of an attribute (local_cpulist of a large host is the longest)
+constexpr std::size_t SYSFS_VALUE_SIZE{256};
+
+class SysfsAttributes {
+public:
+    explicit SysfsAttributes(const InterfaceTable& interfaceList)
+        : interfaceList{interfaceList}, values{interfaceList.resource()} {}
+    SysfsAttributes(const SysfsAttributes&) = delete;
+    SysfsAttributes& operator=(const SysfsAttributes&) = delete;
+
+    /*
+     * Read a set of attributes (sysfsAttributeBit()s) of every interface of the table, but those already read.
+     * Reading an attribute an interface does not have (virtual devices have no device/ directory, links that are
+     * down no speed) leaves it unknown. Without sysfs, nothing is collected and has() stays false.
+     */
+    void collect(unsigned int attributes) {
+        attributes &= ~collected;
+        if (attributes == 0 || interfaceList.empty() || access("/sys/class/net", F_OK) != 0) {
+            return;
+        }
+        if (values.empty()) {
+            values.assign(interfaceList.size() * SYSFS_ATTRIBUTE_COUNT, Value{});
+        }
+
+        std::size_t workerCount{std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                      (interfaceList.size() + SYSFS_INTERFACES_PER_WORKER - 1) /
+                                                          SYSFS_INTERFACES_PER_WORKER)};
+        // Each worker keeps the values it reads in a part of its own; the positions it writes are its own too
+        std::size_t firstPart{parts.size()};
+        parts.resize(firstPart + workerCount);
+        std::atomic<std::size_t> next{0};
+        auto worker{[&](std::size_t part) {
+            char buffer[SYSFS_VALUE_SIZE];
+            for (std::size_t first = next.fetch_add(SYSFS_BATCH_INTERFACES); first < interfaceList.size();
+                 first = next.fetch_add(SYSFS_BATCH_INTERFACES)) {
+                std::size_t last{std::min(first + SYSFS_BATCH_INTERFACES, interfaceList.size())};
+                for (std::size_t position = first; position < last; ++position) {
+                    for (std::size_t column = 0; column < SYSFS_ATTRIBUTE_COUNT; ++column) {
+                        std::string_view value;
+                        if ((attributes & (1u << column)) &&
+                            readSysfsAttribute(interfaceList[position].nameView(), static_cast<SysfsAttribute>(column),
+                                               buffer, sizeof(buffer), value)) {
+                            Value& entry{values[position * SYSFS_ATTRIBUTE_COUNT + column]};
+                            entry.offset = static_cast<std::uint32_t>(parts[part].size());
+                            entry.length = static_cast<std::uint16_t>(value.size());
+                            entry.part = static_cast<std::uint16_t>(part);
+                            parts[part] += value;
+                        }
+                    }
+                }
+            }
+        }};
+        if (workerCount == 1) {
+            worker(firstPart);
+        } else {
+            std::vector<std::thread> workers;
+            for (std::size_t i = 0; i < workerCount; ++i) {
+                workers.emplace_back(worker, firstPart + i);
+            }
+            for (std::thread& thread : workers) {
+                thread.join();
+            }
+        }
+        collected |= attributes;
+    }
+
+    // Whether an attribute was collected, so that value() and number() can be used for it
+    bool has(SysfsAttribute attribute) const { return collected & sysfsAttributeBit(attribute); }
+
+    // Value of a collected attribute of the interface at `position`, without its newline; false if unknown
+    bool value(std::size_t position, SysfsAttribute attribute, std::string_view& result) const {
+        const Value& entry{values[position * SYSFS_ATTRIBUTE_COUNT + static_cast<std::size_t>(attribute)]};
+        if (entry.length == 0) {
+            return false;
+        }
+        result = std::string_view{parts[entry.part].data() + entry.offset, entry.length};
+        return true;
+    }
+
+    // Numeric value of a collected attribute; SYSFS_UNKNOWN if unknown or not a number
+    long number(std::size_t position, SysfsAttribute attribute) const {
+        std::string_view result;
+        if (!value(position, attribute, result)) {
+            return SYSFS_UNKNOWN;
+        }
+        char digits[32];
+        std::size_t length{std::min(result.size(), sizeof(digits) - 1)};
+        std::memcpy(digits, result.data(), length);
+        digits[length] = '\0';
+        char* end{nullptr};
+        long parsed{std::strtol(digits, &end, 10)};
+        return *end == '\0' ? parsed : SYSFS_UNKNOWN;
+    }
+
+private:
+    // Where a value is, in parts[part]; a length of 0 for unknown
+    struct Value {
+        std::uint32_t offset;
+        std::uint16_t length;
+        std::uint16_t part;
+    };
+
+    const InterfaceTable& interfaceList;
+    std::pmr::vector<Value> values; // SYSFS_ATTRIBUTE_COUNT per interface, in table order
+    std::vector<std::string> parts; // Values read by each worker (the arena is not shared between threads)
+    unsigned int collected{0};      // sysfsAttributeBit()s of the attributes read
+};
+
+#endif // IFACEPICKER_SYSFS_BATCH_HPP
@@ -0,0 +1,300 @@
+/*
+ * table_cache.hpp - On-disk cache of the interface table, for repeated runs without a daemon (--cache).
+ *
+ * A run that lists every interface writes the unfiltered table image (see InterfaceTable::appendImage) to the cache
+ * file, along with a change token; the next run recomputes the token and, if it is the same and the file is recent
+ * enough, loads the image instead of enumerating. The token is a hash of what a few cheap probes return:
+ *   - the boot and the network namespace (/proc/sys/kernel/random/boot_id, the inode of /proc/self/ns/net)
+ *   - the entries of /sys/class/net, names and inode numbers: links that are added, removed, renamed or re-created
+ *   - an RTM_GETADDR dump, but for the address lifetimes (IFA_CACHEINFO) that change by themselves: any address change
+ * On a host with 5000 links, the probes take a few milliseconds where the link dump alone takes 15 or more. No probe
+ * sees a link going up or down, so the age of the file is bounded too (--cache-max-age, CACHE_MAX_AGE_MS by default).
+ *
+ * File layout: a TableCacheHeader, then the image. It is written to a temporary file (mkstemp()) that is renamed over
+ * the cache, so that concurrent runs only ever see a complete file, and is checked like any image when it is loaded.
+ */
+
+#ifndef IFACEPICKER_TABLE_CACHE_HPP
+#define IFACEPICKER_TABLE_CACHE_HPP
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "backend.hpp"
+#include "console.hpp"
+#include "descriptor.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "netlink.hpp"
+#include "snapshot.hpp"
+#include "timings.hpp"
+
+constexpr std::uint32_t CACHE_MAGIC{0x69667043}; // "ifpC"
+constexpr std::uint32_t CACHE_VERSION{1};
+
+// How old a cache file may be before it is not trusted any more, whatever its token, unless --cache-max-age is given
+constexpr long CACHE_MAX_AGE_MS{5000};
+
+struct TableCacheHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t token;
+    std::int64_t writtenNs; // CLOCK_REALTIME when the table was enumerated
+    std::uint64_t size;     // Bytes of the image that follows
+};
+
+// Function to get the cache file path; empty (no cache) unless set by the IFACEPICKER_CACHE environment variable or
+// --cache
+inline std::string& cachePath() {
+    static std::string path{std::getenv("IFACEPICKER_CACHE") != nullptr ? std::getenv("IFACEPICKER_CACHE") : ""};
+    return path;
+}
+
+// Function to get the longest a cache file is used for, in milliseconds
+inline long& cacheMaxAge() {
+    static long maxAge{CACHE_MAX_AGE_MS};
+    return maxAge;
+}
+
+// Function to read the real-time clock in nanoseconds, which, unlike the monotonic clock, goes on between runs
+inline std::int64_t realtimeNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+// Function to mix bytes into a 64-bit FNV-1a hash
+inline void hashBytes(std::uint64_t& hash, const void* data, std::size_t size) {
+    const auto* bytes{static_cast<const unsigned char*>(data)};
+    for (std::size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+/*
+ * Compute the change token of the interfaces of this host, as described above. Returns false if a probe failed
+ * (no netlink, no sysfs), in which case the cache is not used at all.
+ */
+inline bool computeChangeToken(std::uint64_t& token) {
+    token = 14695981039346656037ull;
+
+    char bootId[64];
+    DescriptorGuard boot{open("/proc/sys/kernel/random/boot_id", O_RDONLY | O_CLOEXEC)};
+    ssize_t length{boot.fd >= 0 ? read(boot.fd, bootId, sizeof(bootId)) : -1};
+    struct stat netns;
+    if (length <= 0 || stat("/proc/self/ns/net", &netns) < 0) {
+        return false;
+    }
+    hashBytes(token, bootId, static_cast<std::size_t>(length));
+    hashBytes(token, &netns.st_dev, sizeof(netns.st_dev));
+    hashBytes(token, &netns.st_ino, sizeof(netns.st_ino));
+
+    DIR* links{opendir("/sys/class/net")};
+    if (links == nullptr) {
+        return false;
+    }
+    for (const dirent* entry{readdir(links)}; entry != nullptr; entry = readdir(links)) {
+        hashBytes(token, &entry->d_ino, sizeof(entry->d_ino));
+        hashBytes(token, entry->d_name, std::strlen(entry->d_name) + 1);
+    }
+    closedir(links);
+
+    NetlinkRequest request{makeAddressDumpRequest(InterfaceFilter{})};
+    std::uint64_t linksToken{token};
+    return retryOnLargeDatagram([&]() {
+        token = linksToken;
+        NetlinkSocket socket;
+        return socket.open() && socket.send(request) && socket.receive([&](const nlmsghdr* message) {
+            if (message->nlmsg_type != RTM_NEWADDR) {
+                return;
+            }
+            const auto* info{static_cast<const ifaddrmsg*>(NLMSG_DATA(message))};
+            hashBytes(token, info, sizeof(*info));
+            auto remaining{static_cast<unsigned int>(IFA_PAYLOAD(message))};
+            for (const rtattr* attribute{IFA_RTA(info)}; RTA_OK(attribute, remaining);
+                 attribute = RTA_NEXT(attribute, remaining)) {
+                if (attribute->rta_type != IFA_CACHEINFO) {
+                    hashBytes(token, attribute, attribute->rta_len);
+                }
+            }
+        });
+    });
+}
+
+/*
+ * Load the cached table into `interfaceList`, filtered, if the cache file has this token and is recent enough.
+ * Returns false, leaving the table empty, otherwise.
+ */
+inline bool readTableCache(std::uint64_t token, InterfaceTable& interfaceList, const InterfaceFilter& filter) {
+    TimedPhase openPhase{Phase::Open};
+    DescriptorGuard guard{open(cachePath().c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat status;
+    if (guard.fd < 0 || fstat(guard.fd, &status) < 0 ||
+        static_cast<std::size_t>(status.st_size) < sizeof(TableCacheHeader)) {
+        return false;
+    }
+    openPhase.stop();
+
+    std::pmr::vector<char> contents(static_cast<std::size_t>(status.st_size), interfaceList.resource());
+    std::size_t filled{0};
+    while (filled < contents.size()) {
+        ssize_t length{read(guard.fd, contents.data() + filled, contents.size() - filled)};
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            return false;
+        }
+        filled += static_cast<std::size_t>(length);
+    }
+    timings().count(Counter::BytesRead, filled);
+
+    TableCacheHeader header;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    std::int64_t age{realtimeNanoseconds() - header.writtenNs};
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.token != token ||
+        header.size != contents.size() - sizeof(header) || age < 0 ||
+        age > static_cast<std::int64_t>(cacheMaxAge()) * 1000000) {
+        return false;
+    }
+
+    bool filtered{filter.family != AF_UNSPEC || filter.upOnly};
+    InterfaceTable unfiltered{interfaceList.resource()};
+    InterfaceTable& target{filtered ? unfiltered : interfaceList};
+    if (!target.loadImage(contents.data() + sizeof(header), header.size)) {
+        target.clear();
+        return false;
+    }
+    if (filtered) {
+        copyFiltered(unfiltered, filter, nullptr, interfaceList);
+    }
+    return true;
+}
+
+// Function to write an unfiltered table to the cache file; returns false (with errno set) if it could not be written
+inline bool writeTableCache(std::uint64_t token, std::int64_t enumeratedNs, const InterfaceTable& interfaceList) {
+    OutputBuffer contents{interfaceList.resource()};
+    contents.reserve(sizeof(TableCacheHeader) + interfaceList.imageSize());
+    contents.resize(sizeof(TableCacheHeader));
+    interfaceList.appendImage(contents);
+    TableCacheHeader header{CACHE_MAGIC, CACHE_VERSION, token, enumeratedNs,
+                            contents.size() - sizeof(TableCacheHeader)};
+    std::memcpy(contents.data(), &header, sizeof(header));
+
+    // Each run writes a new file of its own, which mkstemp() creates exclusively: concurrent runs do not write into
+    // each other's, and a name planted beforehand (e.g. a symlink, in a shared directory) is never written through
+    std::string temporaryPath{cachePath() + ".XXXXXX"};
+    int fd{mkostemp(temporaryPath.data(), O_CLOEXEC)};
+    if (fd < 0) {
+        return false;
+    }
+    if (fchmod(fd, 0644) < 0) {
+        int error{errno};
+        close(fd);
+        unlink(temporaryPath.c_str());
+        errno = error;
+        return false;
+    }
+    const char* data{contents.data()};
+    std::size_t size{contents.size()};
+    while (size > 0) {
+        ssize_t length{write(fd, data, size)};
+        if (length < 0 && errno == EINTR) {
+            continue;
+        }
+        if (length < 0) {
+            break;
+        }
+        data += length;
+        size -= static_cast<std::size_t>(length);
+    }
+    bool written{size == 0};
+    int error{errno};
+    if (close(fd) < 0 && written) {
+        written = false;
+        error = errno;
+    }
+    if (!written || rename(temporaryPath.c_str(), cachePath().c_str()) < 0) {
+        error = written ? errno : error;
+        unlink(temporaryPath.c_str());
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Fill the interface list as enumerateInterfaces() does, through the cache when one is configured: with
+ * Backend::Auto and no link type filter (link kinds are not part of the image), a running daemon's snapshot or socket
+ * is still tried first, being cheaper than the token probes and always current; then a valid cache is loaded instead
+ * of enumerating (`used` is then Backend::Cache); otherwise the whole table is enumerated, written to the cache, and
+ * filtered.
+ */
+inline bool enumerateThroughCache(Backend backend, InterfaceTable& interfaceList, const InterfaceFilter& filter,
+                                  Backend& used) {
+    if (cachePath().empty() || backend != Backend::Auto || filter.hasLinkType()) {
+        return enumerateInterfaces(backend, interfaceList, filter, used);
+    }
+
+    for (Backend candidate : {Backend::Snapshot, Backend::Daemon}) {
+        if (enumerateWith(candidate, interfaceList, filter)) {
+            used = candidate;
+            return true;
+        }
+        interfaceList.clear();
+    }
+    // The backends of BACKEND_PREFERENCE that enumerate by themselves, now that there is no daemon to ask
+    auto enumerateWithoutDaemon{[&](InterfaceTable& table, const InterfaceFilter& tableFilter) {
+        for (Backend candidate : BACKEND_PREFERENCE) {
+            if (candidate == Backend::Snapshot || candidate == Backend::Daemon) {
+                continue;
+            }
+            if (enumerateWith(candidate, table, tableFilter)) {
+                used = candidate;
+                return true;
+            }
+            table.clear();
+        }
+        return false;
+    }};
+
+    std::uint64_t token;
+    if (!computeChangeToken(token)) {
+        return enumerateWithoutDaemon(interfaceList, filter);
+    }
+    if (readTableCache(token, interfaceList, filter)) {
+        used = Backend::Cache;
+        return true;
+    }
+    interfaceList.clear();
+
+    std::int64_t enumeratedNs{realtimeNanoseconds()};
+    InterfaceTable unfiltered{interfaceList.resource()};
+    unfiltered.keepLinkAttributes(interfaceList.keepsLinkAttributes());
+    if (!enumerateWithoutDaemon(unfiltered, InterfaceFilter{})) {
+        return false;
+    }
+    if (!writeTableCache(token, enumeratedNs, unfiltered)) {
+        errorMessage() << "Error writing " << cachePath() << ": " << std::strerror(errno) << '\n';
+    }
+    if (filter.family != AF_UNSPEC || filter.upOnly) {
+        copyFiltered(unfiltered, filter, nullptr, interfaceList);
+    } else {
+        interfaceList = std::move(unfiltered);
+    }
+    return true;
+}
+
+#endif // IFACEPICKER_TABLE_CACHE_HPP
@@ -0,0 +1,275 @@
+/*
+ * table_index.hpp - Constant-time lookups in an interface table.
+ *
+ * Selecting by name or by kernel index, and finding the interface that owns an address, would otherwise scan the
+ * whole table for each query, which adds up when a batch (or a fleet run) asks many questions of a table of 10k+
+ * interfaces. An InterfaceIndex is built once per table, each part on its first use:
+ *   - Two open-addressing hash tables (linear probing, at most half full) map names and ifindexes to positions.
+ *   - A path-compressed binary prefix tree per family maps addresses to their interface: each address adds its
+ *     network (address/prefix length) and the address itself as a host route, so a lookup finds the interface
+ *     configured with that very address first, then the one with the longest prefix containing it (--owner-of).
+ * On equal keys (e.g. the same link-local prefix on several interfaces) the first listed interface wins, as with a
+ * linear scan. The index refers to the table's positions and must be rebuilt if the table changes.
+ */
+
+#ifndef IFACEPICKER_TABLE_INDEX_HPP
+#define IFACEPICKER_TABLE_INDEX_HPP
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "interface_table.hpp"
+
+// Returned by lookups (and by findInterface(), see selector.hpp) when no interface is selected
+constexpr std::size_t NO_INTERFACE{static_cast<std::size_t>(-1)};
+
+// An address with a prefix length, as given to --owner-of
+struct AddressPrefix {
+    int family{AF_UNSPEC};
+    std::uint8_t bytes[16]{};
+    unsigned int length{0};
+};
+
+// Function to parse ADDRESS or ADDRESS/PREFIX; without a prefix, the whole address (/32 or /128)
+inline bool parseAddressPrefix(const std::string& text, AddressPrefix& prefix) {
+    std::size_t slash{text.find('/')};
+    std::string address{text.substr(0, slash)};
+    if (inet_pton(AF_INET, address.c_str(), prefix.bytes) == 1) {
+        prefix.family = AF_INET;
+    } else if (inet_pton(AF_INET6, address.c_str(), prefix.bytes) == 1) {
+        prefix.family = AF_INET6;
+    } else {
+        return false;
+    }
+    unsigned int maximum{prefix.family == AF_INET ? 32u : 128u};
+    prefix.length = maximum;
+    if (slash == std::string::npos) {
+        return true;
+    }
+    std::string length{text.substr(slash + 1)};
+    char* end{nullptr};
+    unsigned long value{std::strtoul(length.c_str(), &end, 10)};
+    if (length.empty() || *end != '\0' || value > maximum) {
+        return false;
+    }
+    prefix.length = static_cast<unsigned int>(value);
+    return true;
+}
+
+class InterfaceIndex {
+public:
+    explicit InterfaceIndex(const InterfaceTable& interfaceList)
+        : interfaceList{interfaceList}, nameSlots{interfaceList.resource()}, indexSlots{interfaceList.resource()},
+          nodes{interfaceList.resource()} {}
+
+    // Position of the first interface with this name, or NO_INTERFACE
+    std::size_t findName(std::string_view name) {
+        if (nameSlots.empty()) {
+            buildHashes();
+        }
+        std::size_t mask{nameSlots.size() - 1};
+        for (std::size_t slot{hashName(name) & mask};; slot = (slot + 1) & mask) {
+            std::uint32_t entry{nameSlots[slot]};
+            if (entry == 0) {
+                return NO_INTERFACE;
+            }
+            if (interfaceList[entry - 1].nameView() == name) {
+                return entry - 1;
+            }
+        }
+    }
+
+    // Position of the first interface with this kernel index, or NO_INTERFACE
+    std::size_t findIndex(int index) {
+        if (indexSlots.empty()) {
+            buildHashes();
+        }
+        std::size_t mask{indexSlots.size() - 1};
+        for (std::size_t slot{hashIndex(index) & mask};; slot = (slot + 1) & mask) {
+            std::uint32_t entry{indexSlots[slot]};
+            if (entry == 0) {
+                return NO_INTERFACE;
+            }
+            if (interfaceList[entry - 1].index == index) {
+                return entry - 1;
+            }
+        }
+    }
+
+    /*
+     * Position of the interface owning an address: the one configured with it, else the one whose network is the
+     * longest prefix containing it. With a prefix shorter than the address, only networks containing that whole
+     * prefix count (10.1.2.3/24: the interface on 10.1.2.0/24 or a larger network). NO_INTERFACE if there is none.
+     */
+    std::size_t findOwner(const AddressPrefix& prefix) {
+        if (nodes.empty()) {
+            buildTree();
+        }
+        std::uint32_t node{prefix.family == AF_INET6 ? 1u : 0u};
+        std::uint32_t best{0};
+        while (true) {
+            if (nodes[node].owner != 0) {
+                best = nodes[node].owner;
+            }
+            if (nodes[node].length >= prefix.length) {
+                break;
+            }
+            std::uint32_t child{nodes[node].children[bit(prefix.bytes, nodes[node].length)]};
+            if (child == 0 || nodes[child].length > prefix.length ||
+                commonLength(nodes[child].key, prefix.bytes, nodes[child].length) < nodes[child].length) {
+                break;
+            }
+            node = child;
+        }
+        return best == 0 ? NO_INTERFACE : best - 1;
+    }
+
+private:
+    // A node of the prefix tree: the first `length` bits of `key`, and the interface position + 1 if it is an entry
+    struct Node {
+        std::uint8_t key[16];
+        std::uint32_t length;
+        std::uint32_t owner;
+        std::uint32_t children[2]; // 0 for none (node 0 is a root, never a child)
+    };
+
+    static std::uint64_t hashName(std::string_view name) {
+        // FNV-1a
+        std::uint64_t hash{14695981039346656037ull};
+        for (char c : name) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::uint64_t hashIndex(int index) {
+        // Fibonacci hashing, keeping the high bits
+        return (static_cast<std::uint64_t>(static_cast<unsigned int>(index)) * 11400714819323198485ull) >> 32;
+    }
+
+    void buildHashes() {
+        std::size_t capacity{16};
+        while (capacity < interfaceList.size() * 2) {
+            capacity *= 2;
+        }
+        nameSlots.assign(capacity, 0);
+        indexSlots.assign(capacity, 0);
+        std::size_t mask{capacity - 1};
+        for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+            const InterfaceRecord& record{interfaceList[i]};
+            // Later duplicates are left out, so that the first listed is found
+            for (std::size_t slot{hashName(record.nameView()) & mask};; slot = (slot + 1) & mask) {
+                if (nameSlots[slot] == 0) {
+                    nameSlots[slot] = static_cast<std::uint32_t>(i + 1);
+                    break;
+                }
+                if (interfaceList[nameSlots[slot] - 1].nameView() == record.nameView()) {
+                    break;
+                }
+            }
+            for (std::size_t slot{hashIndex(record.index) & mask};; slot = (slot + 1) & mask) {
+                if (indexSlots[slot] == 0) {
+                    indexSlots[slot] = static_cast<std::uint32_t>(i + 1);
+                    break;
+                }
+                if (interfaceList[indexSlots[slot] - 1].index == record.index) {
+                    break;
+                }
+            }
+        }
+    }
+
+    void buildTree() {
+        // One root per family: node 0 for IPv4, node 1 for IPv6
+        nodes.reserve(2 + interfaceList.addressTotal() * 4);
+        nodes.push_back(Node{});
+        nodes.push_back(Node{});
+        for (std::size_t i = 0; i < interfaceList.size(); ++i) {
+            auto owner{static_cast<std::uint32_t>(i + 1)};
+            for (const AddressRecord& entry : interfaceList.addresses(interfaceList[i])) {
+                std::uint8_t key[16]{};
+                std::memcpy(key, &entry.address, entry.family == AF_INET6 ? sizeof(in6_addr) : sizeof(in_addr));
+                std::uint32_t root{entry.family == AF_INET6 ? 1u : 0u};
+                std::uint32_t maximum{entry.family == AF_INET6 ? 128u : 32u};
+                insert(root, key, entry.prefixLength < maximum ? entry.prefixLength : maximum, owner);
+                insert(root, key, maximum, owner);
+            }
+        }
+    }
+
+    // Function to add an entry to the tree below `node`, unless an earlier interface has the same one
+    void insert(std::uint32_t node, const std::uint8_t* key, std::uint32_t length, std::uint32_t owner) {
+        while (true) {
+            if (nodes[node].length == length) {
+                if (nodes[node].owner == 0) {
+                    nodes[node].owner = owner;
+                }
+                return;
+            }
+            int side{bit(key, nodes[node].length)};
+            std::uint32_t child{nodes[node].children[side]};
+            if (child == 0) {
+                nodes[node].children[side] = addNode(key, length, owner);
+                return;
+            }
+            std::uint32_t childLength{nodes[child].length};
+            std::uint32_t common{commonLength(nodes[child].key, key, childLength < length ? childLength : length)};
+            if (common == childLength) {
+                node = child;
+                continue;
+            }
+
+            // The child and the new entry part ways after `common` bits: put a node there, owning both
+            std::uint32_t split{addNode(key, common, common == length ? owner : 0)};
+            nodes[split].children[bit(nodes[child].key, common)] = child;
+            if (common != length) {
+                nodes[split].children[bit(key, common)] = addNode(key, length, owner);
+            }
+            nodes[node].children[side] = split;
+            return;
+        }
+    }
+
+    std::uint32_t addNode(const std::uint8_t* key, std::uint32_t length, std::uint32_t owner) {
+        Node& node{nodes.emplace_back()};
+        std::memcpy(node.key, key, sizeof(node.key));
+        node.length = length;
+        node.owner = owner;
+        node.children[0] = 0;
+        node.children[1] = 0;
+        return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+
+    // Bit `position` of a key, counting from the most significant bit of the first byte
+    static int bit(const std::uint8_t* key, std::uint32_t position) {
+        return (key[position / 8] >> (7 - position % 8)) & 1;
+    }
+
+    // Function to count the leading bits two keys have in common, up to `limit`
+    static std::uint32_t commonLength(const std::uint8_t* a, const std::uint8_t* b, std::uint32_t limit) {
+        for (std::uint32_t byte = 0; byte * 8 < limit; ++byte) {
+            unsigned int difference{static_cast<unsigned int>(a[byte] ^ b[byte])};
+            if (difference != 0) {
+                std::uint32_t common{byte * 8 + static_cast<std::uint32_t>(__builtin_clz(difference) - 24)};
+                return common < limit ? common : limit;
+            }
+        }
+        return limit;
+    }
+
+    const InterfaceTable& interfaceList;
+    std::pmr::vector<std::uint32_t> nameSlots;  // Position + 1 of the interface, 0 for an empty slot
+    std::pmr::vector<std::uint32_t> indexSlots; // Same, by kernel index
+    std::pmr::vector<Node> nodes;
+};
+
+#endif // IFACEPICKER_TABLE_INDEX_HPP
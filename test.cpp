@@ -0,0 +1,143 @@
+/*
+ * ifacepicker-test - Checks of the parts that can be driven without touching the host.
+ * Built and run by `make test`.
+ *
+ * Each check feeds synthetic netlink messages to the code under test and compares the result with what the kernel
+ * state would be. One line is printed per check; a failed check makes the exit status 1.
+ *
+ * Compilation: g++ test.cpp -o ifacepicker-test -pthread
+ */
+
+#include <arpa/inet.h>
+#include <net/if_arp.h>
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+
+#include "live_state.hpp"
+
+// One netlink message under construction, with room for a few attributes
+class TestMessage {
+public:
+    TestMessage(std::uint16_t type, const void* payload, std::size_t payloadLength) {
+        header()->nlmsg_len = NLMSG_LENGTH(payloadLength);
+        header()->nlmsg_type = type;
+        std::memcpy(NLMSG_DATA(header()), payload, payloadLength);
+    }
+
+    // Append an attribute; returns it so that nested attributes can be closed with endNested()
+    rtattr* attribute(std::uint16_t type, const void* value, std::size_t length) {
+        auto* attribute{reinterpret_cast<rtattr*>(buffer + NLMSG_ALIGN(header()->nlmsg_len))};
+        attribute->rta_type = type;
+        attribute->rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+        std::memcpy(RTA_DATA(attribute), value, length);
+        header()->nlmsg_len = NLMSG_ALIGN(header()->nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+        return attribute;
+    }
+
+    // Make `nested` (returned by attribute() with no value) span every attribute appended after it
+    void endNested(rtattr* nested) {
+        nested->rta_len = static_cast<unsigned short>(buffer + header()->nlmsg_len - reinterpret_cast<char*>(nested));
+    }
+
+    nlmsghdr* header() { return reinterpret_cast<nlmsghdr*>(buffer); }
+
+private:
+    alignas(NLMSG_ALIGNTO) char buffer[1024]{};
+};
+
+// Function to build an RTM_NEWLINK or RTM_DELLINK message of `family` for the link `index` called `name`
+inline TestMessage linkMessage(std::uint16_t type, unsigned char family, int index, const char* name, const char* kind) {
+    ifinfomsg info{};
+    info.ifi_family = family;
+    info.ifi_type = ARPHRD_ETHER;
+    info.ifi_index = index;
+    info.ifi_flags = IFF_UP | IFF_BROADCAST | IFF_MULTICAST;
+    TestMessage message{type, &info, sizeof(info)};
+    message.attribute(IFLA_IFNAME, name, std::strlen(name) + 1);
+    if (kind != nullptr) {
+        rtattr* linkInfo{message.attribute(IFLA_LINKINFO, nullptr, 0)};
+        message.attribute(IFLA_INFO_KIND, kind, std::strlen(kind) + 1);
+        message.endNested(linkInfo);
+    }
+    return message;
+}
+
+// Function to build an RTM_NEWADDR message for the IPv4 address `text`/`prefixLength` of the link `index`
+inline TestMessage inetMessage(int index, const char* text, unsigned char prefixLength) {
+    ifaddrmsg info{};
+    info.ifa_family = AF_INET;
+    info.ifa_prefixlen = prefixLength;
+    info.ifa_index = static_cast<unsigned int>(index);
+    TestMessage message{RTM_NEWADDR, &info, sizeof(info)};
+    in_addr address{};
+    inet_pton(AF_INET, text, &address);
+    message.attribute(IFA_ADDRESS, &address, sizeof(address));
+    message.attribute(IFA_LOCAL, &address, sizeof(address));
+    return message;
+}
+
+// A port joining and leaving a bridge sends AF_BRIDGE RTM_NEWLINK/RTM_DELLINK; the link and its addresses stay
+inline bool testBridgePortRelease() {
+    LiveInterfaceState state;
+    state.apply(linkMessage(RTM_NEWLINK, AF_UNSPEC, 7, "vt0", "veth").header());
+    state.apply(inetMessage(7, "10.9.9.1", 24).header());
+    std::uint64_t generation{state.generation()};
+
+    state.apply(linkMessage(RTM_NEWLINK, AF_BRIDGE, 7, "vt0", "bridge").header());
+    state.apply(linkMessage(RTM_DELLINK, AF_BRIDGE, 7, "vt0", nullptr).header());
+
+    auto link{state.linkMap().find(7)};
+    return state.generation() == generation && link != state.linkMap().end() &&
+           std::strcmp(link->second.name, "vt0") == 0 && std::strcmp(link->second.kind, "veth") == 0 &&
+           link->second.addresses.size() == 1;
+}
+
+// An AF_UNSPEC RTM_DELLINK still removes the link
+inline bool testLinkRemoval() {
+    LiveInterfaceState state;
+    state.apply(linkMessage(RTM_NEWLINK, AF_UNSPEC, 7, "vt0", "veth").header());
+    state.apply(linkMessage(RTM_DELLINK, AF_UNSPEC, 7, "vt0", nullptr).header());
+    return state.size() == 0;
+}
+
+// Counts the callbacks of a LiveInterfaceState, as InterfaceWatcher receives them
+class CountingObserver : public LiveStateObserver {
+public:
+    void linkChanged(int, const LiveLink*, const LiveLink*) override { ++changes; }
+    void addressChanged(int, const LiveLink&, const AddressRecord&, bool) override { ++changes; }
+    int changes{0};
+};
+
+// Watch mode prints what the observer reports, so a bridge port release must not reach it
+inline bool testBridgePortReleaseUnobserved() {
+    LiveInterfaceState state;
+    state.apply(linkMessage(RTM_NEWLINK, AF_UNSPEC, 7, "vt0", "veth").header());
+    state.apply(inetMessage(7, "10.9.9.1", 24).header());
+    CountingObserver observer;
+    state.setObserver(&observer);
+    state.apply(linkMessage(RTM_NEWLINK, AF_BRIDGE, 7, "vt0", nullptr).header());
+    state.apply(linkMessage(RTM_DELLINK, AF_BRIDGE, 7, "vt0", nullptr).header());
+    return observer.changes == 0;
+}
+
+struct TestCase {
+    const char* name;
+    std::function<bool()> run;
+};
+
+int main() {
+    const TestCase tests[]{
+        {"live_state.bridge_port_release", testBridgePortRelease},
+        {"live_state.link_removal", testLinkRemoval},
+        {"watch.bridge_port_release", testBridgePortReleaseUnobserved},
+    };
+    bool succeeded{true};
+    for (const TestCase& test : tests) {
+        bool passed{test.run()};
+        std::printf("%-40s %s\n", test.name, passed ? "ok" : "FAILED");
+        succeeded = passed && succeeded;
+    }
+    return succeeded ? 0 : 1;
+}
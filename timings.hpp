@@ -0,0 +1,140 @@
+/*
+ * timings.hpp - Phase durations and counters reported by --timings.
+ *
+ * Phases are timed with CLOCK_MONOTONIC by TimedPhase objects placed around the interesting parts of a run; a phase
+ * entered several times (e.g. when Backend::Auto tries more than one backend) accumulates its durations. Counters are
+ * bumped by the code that reads and parses data. Both are always collected, as they cost a clock read or an atomic
+ * increment, and only reported (on stderr, when the run ends) if --timings was given:
+ *   backend=netlink total_ns=... open_ns=... enumerate_ns=... select_ns=... output_ns=... bytes_read=... ...
+ * or the same keys as one JSON object with --timings=json.
+ */
+
+#ifndef IFACEPICKER_TIMINGS_HPP
+#define IFACEPICKER_TIMINGS_HPP
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+enum class Phase { Total, Open, Enumerate, Select, Output, Count };
+
+// Report keys of the phases, in Phase order
+constexpr const char* PHASE_NAMES[]{"total_ns", "open_ns", "enumerate_ns", "select_ns", "output_ns"};
+
+enum class Counter {
+    BytesRead,      // Bytes read from the kernel, a pipe, a file, the daemon or the snapshot
+    LinesRead,      // Text lines (ioctl backend) or JSON objects (ip backend) read
+    MessagesRead,   // Netlink messages received
+    Interfaces,     // Interface records in the final table
+    Addresses,      // Address records in the final table
+    Allocations,    // Calls to operator new
+    AllocatedBytes, // Bytes requested from operator new
+    OutputBytes,    // Bytes written to stdout
+    SysfsFiles,     // Attribute files read from /sys/class/net
+    SysfsSyscalls,  // Syscalls spent reading them: open, read and close each, or io_uring_enter per batch
+    Count
+};
+
+// Report keys of the counters, in Counter order
+constexpr const char* COUNTER_NAMES[]{"bytes_read",   "lines_read",  "messages_read", "interfaces",
+                                      "addresses",    "allocations", "allocated_bytes", "output_bytes",
+                                      "sysfs_files", "sysfs_syscalls"};
+
+// Function to read the monotonic clock in nanoseconds
+inline std::int64_t monotonicNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+class Timings {
+public:
+    enum class Style { None, KeyValue, Json };
+
+    void addPhase(Phase phase, std::int64_t nanoseconds) {
+        phases[static_cast<int>(phase)].fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void count(Counter counter, std::uint64_t amount = 1) {
+        counters[static_cast<int>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value(Counter counter) const { return counters[static_cast<int>(counter)].load(); }
+
+    // Name of the backend that produced the table
+    void setBackend(const char* name) { backend = name; }
+
+    void setStyle(Style reportStyle) { style = reportStyle; }
+    bool enabled() const { return style != Style::None; }
+
+    // Write the report to stderr, in a single write
+    void report() const {
+        if (!enabled()) {
+            return;
+        }
+        // Read first, so that allocating the report does not count in it
+        std::uint64_t values[static_cast<int>(Phase::Count) + static_cast<int>(Counter::Count)];
+        for (int i = 0; i < static_cast<int>(Phase::Count); ++i) {
+            values[i] = static_cast<std::uint64_t>(phases[i].load());
+        }
+        for (int i = 0; i < static_cast<int>(Counter::Count); ++i) {
+            values[static_cast<int>(Phase::Count) + i] = counters[i].load();
+        }
+
+        bool json{style == Style::Json};
+        std::string out{json ? "{\"backend\":\"" : "backend="};
+        out += backend;
+        out += json ? "\"" : "";
+        auto append{[&](const char* key, std::uint64_t number) {
+            out += json ? ",\"" : " ";
+            out += key;
+            out += json ? "\":" : "=";
+            out += std::to_string(number);
+        }};
+        for (int i = 0; i < static_cast<int>(Phase::Count); ++i) {
+            append(PHASE_NAMES[i], values[i]);
+        }
+        for (int i = 0; i < static_cast<int>(Counter::Count); ++i) {
+            append(COUNTER_NAMES[i], values[static_cast<int>(Phase::Count) + i]);
+        }
+        out += json ? "}\n" : "\n";
+        std::fwrite(out.data(), 1, out.size(), stderr);
+    }
+
+private:
+    Style style{Style::None};
+    const char* backend{"none"};
+    std::atomic<std::int64_t> phases[static_cast<int>(Phase::Count)]{};
+    std::atomic<std::uint64_t> counters[static_cast<int>(Counter::Count)]{};
+};
+
+// The timings of this run
+inline Timings& timings() {
+    static Timings instance;
+    return instance;
+}
+
+// Adds the time between its construction and its destruction (or stop()) to a phase
+class TimedPhase {
+public:
+    explicit TimedPhase(Phase timedPhase) : phase{timedPhase}, start{monotonicNanoseconds()} {}
+    TimedPhase(const TimedPhase&) = delete;
+    TimedPhase& operator=(const TimedPhase&) = delete;
+    ~TimedPhase() { stop(); }
+
+    void stop() {
+        if (start != 0) {
+            timings().addPhase(phase, monotonicNanoseconds() - start);
+            start = 0;
+        }
+    }
+
+private:
+    Phase phase;
+    std::int64_t start;
+};
+
+#endif // IFACEPICKER_TIMINGS_HPP
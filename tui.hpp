@@ -0,0 +1,395 @@
+/*
+ * tui.hpp - Full-screen interface picker with incremental search (--tui).
+ *
+ * Instead of printing every interface and reading a number, the picker shows a search line and the interfaces whose
+ * name contains what was typed (case-insensitively). It is drawn on /dev/tty, so stdout keeps only the result, as in
+ * `eval "$(ifacepicker --tui)"`:
+ *   typing          Refines the search          Up/Down, Ctrl-P/N   Moves the selection
+ *   Backspace       Widens it again             PgUp/PgDn           Moves by a screen
+ *   Ctrl-U          Clears it                   Enter               Selects
+ *   Esc, Ctrl-C     Cancels
+ *
+ * Searching stays interactive with thousands of interfaces because no keystroke rescans the table: every result set
+ * is a subset of the one before it. A typed character only filters the previous results, intersected first with the
+ * posting list of the query's last trigram (from an index built once over the names) when the query has at least
+ * three characters; the results of each shorter query are kept, so Backspace is free. Only the rows that fit on the
+ * terminal are rendered, each frame with a single write(2).
+ */
+
+#ifndef IFACEPICKER_TUI_HPP
+#define IFACEPICKER_TUI_HPP
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "arena.hpp"
+#include "interface_table.hpp"
+#include "selector.hpp"
+
+// Function to lower an ASCII letter; interface names are ASCII in practice
+inline char foldCase(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Function to tell whether `name` contains `query` (already folded), ignoring case
+inline bool containsFolded(std::string_view name, std::string_view query) {
+    if (query.size() > name.size()) {
+        return false;
+    }
+    for (std::size_t start = 0; start + query.size() <= name.size(); ++start) {
+        std::size_t i{0};
+        while (i < query.size() && foldCase(name[start + i]) == query[i]) {
+            ++i;
+        }
+        if (i == query.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Incremental substring search over the names of a table.
+ * - push(): Adds a character to the query and refines the current results.
+ * - pop(): Removes the last character, going back to the results it had before.
+ * results() are table positions in table order.
+ */
+class NameIndex {
+public:
+    explicit NameIndex(const InterfaceTable& table)
+        : interfaceList{table}, postings{table.resource()}, levels(1) {
+        levels[0].reserve(table.size());
+        for (std::uint32_t i = 0; i < table.size(); ++i) {
+            levels[0].push_back(i);
+            std::string_view name{table[i].nameView()};
+            for (std::size_t start = 0; start + 3 <= name.size(); ++start) {
+                std::vector<std::uint32_t>& positions{postings[trigram(name.data() + start)]};
+                // A trigram can repeat within a name
+                if (positions.empty() || positions.back() != i) {
+                    positions.push_back(i);
+                }
+            }
+        }
+    }
+
+    const std::vector<std::uint32_t>& results() const { return levels.back(); }
+    const std::string& query() const { return text; }
+
+    void push(char c) {
+        text += foldCase(c);
+        const std::vector<std::uint32_t>& previous{levels.back()};
+        std::vector<std::uint32_t> next;
+        auto keep{[&](std::uint32_t position) {
+            if (containsFolded(interfaceList[position].nameView(), text)) {
+                next.push_back(position);
+            }
+        }};
+
+        if (text.size() < 3) {
+            for (std::uint32_t position : previous) {
+                keep(position);
+            }
+        } else {
+            // Only names with the query's last trigram can match: intersect the two sorted lists
+            auto found{postings.find(trigram(text.data() + text.size() - 3))};
+            if (found != postings.end()) {
+                const std::vector<std::uint32_t>& candidates{found->second};
+                std::size_t i{0};
+                std::size_t j{0};
+                while (i < previous.size() && j < candidates.size()) {
+                    if (previous[i] < candidates[j]) {
+                        ++i;
+                    } else if (candidates[j] < previous[i]) {
+                        ++j;
+                    } else {
+                        keep(previous[i]);
+                        ++i;
+                        ++j;
+                    }
+                }
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+
+    void pop() {
+        if (!text.empty()) {
+            text.pop_back();
+            levels.pop_back();
+        }
+    }
+
+    void clear() {
+        text.clear();
+        levels.resize(1);
+    }
+
+private:
+    // Function to pack three folded characters into a key
+    static std::uint32_t trigram(const char* start) {
+        return static_cast<std::uint32_t>(static_cast<unsigned char>(foldCase(start[0]))) << 16 |
+               static_cast<std::uint32_t>(static_cast<unsigned char>(foldCase(start[1]))) << 8 |
+               static_cast<std::uint32_t>(static_cast<unsigned char>(foldCase(start[2])));
+    }
+
+    const InterfaceTable& interfaceList;
+    std::pmr::unordered_map<std::uint32_t, std::vector<std::uint32_t>> postings;
+    std::string text;                               // Folded query
+    std::vector<std::vector<std::uint32_t>> levels; // Results of each prefix of the query; levels[0] is everything
+};
+
+// How long to wait for the rest of an escape sequence (arrow keys...) before taking Esc as a key
+constexpr int TERMINAL_ESCAPE_MS{30};
+
+// Set by SIGWINCH, so that the next frame is drawn for the new size
+inline volatile sig_atomic_t& terminalResized() {
+    static volatile sig_atomic_t resized{0};
+    return resized;
+}
+
+/*
+ * The controlling terminal in raw mode on the alternate screen, restored when destroyed. Signals are not generated
+ * by the terminal (Ctrl-C is read as a key), so the terminal is always restored.
+ */
+class Terminal {
+public:
+    Terminal() = default;
+    Terminal(const Terminal&) = delete;
+    Terminal& operator=(const Terminal&) = delete;
+
+    ~Terminal() {
+        if (fd < 0) {
+            return;
+        }
+        writeAll("\x1b[?1049l");
+        tcsetattr(fd, TCSAFLUSH, &saved);
+        sigaction(SIGWINCH, &savedResize, nullptr);
+        close(fd);
+    }
+
+    bool open() {
+        fd = ::open("/dev/tty", O_RDWR | O_CLOEXEC);
+        if (fd < 0 || tcgetattr(fd, &saved) != 0) {
+            return fail();
+        }
+        termios raw{saved};
+        raw.c_iflag &= ~static_cast<tcflag_t>(ICRNL | IXON | ISTRIP | BRKINT);
+        raw.c_oflag &= ~static_cast<tcflag_t>(OPOST);
+        raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        if (tcsetattr(fd, TCSAFLUSH, &raw) != 0) {
+            return fail();
+        }
+
+        // Without SA_RESTART, so that a resize interrupts the read() waiting for a key
+        struct sigaction resize{};
+        resize.sa_handler = [](int) { terminalResized() = 1; };
+        sigemptyset(&resize.sa_mask);
+        sigaction(SIGWINCH, &resize, &savedResize);
+        writeAll("\x1b[?1049h");
+        return true;
+    }
+
+    // Size of the terminal; 24x80 if it cannot be queried
+    void size(std::size_t& rows, std::size_t& columns) const {
+        winsize window{};
+        bool known{ioctl(fd, TIOCGWINSZ, &window) == 0 && window.ws_row > 0 && window.ws_col > 0};
+        rows = known ? window.ws_row : 24;
+        columns = known ? window.ws_col : 80;
+    }
+
+    /*
+     * Read the next keys; returns 0 if interrupted by a resize and -1 on errors. An escape sequence split across
+     * reads is completed if the rest follows within TERMINAL_ESCAPE_MS; otherwise the Esc is a key of its own.
+     */
+    ssize_t read(char* buffer, std::size_t size) {
+        ssize_t length{::read(fd, buffer, size)};
+        if (length < 0 && errno == EINTR) {
+            return 0;
+        }
+        if (length <= 0) {
+            return -1;
+        }
+        while (static_cast<std::size_t>(length) < size && incompleteEscape(buffer, static_cast<std::size_t>(length))) {
+            pollfd input{fd, POLLIN, 0};
+            if (poll(&input, 1, TERMINAL_ESCAPE_MS) <= 0) {
+                break;
+            }
+            ssize_t more{::read(fd, buffer + length, size - static_cast<std::size_t>(length))};
+            if (more <= 0) {
+                break;
+            }
+            length += more;
+        }
+        return length;
+    }
+
+    bool writeAll(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t written{::write(fd, data.data(), data.size())};
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(static_cast<std::size_t>(written));
+        }
+        return true;
+    }
+
+private:
+    // Function to tell whether the keys end in the middle of an escape sequence (Esc, "Esc [" or "Esc [ digit")
+    static bool incompleteEscape(const char* keys, std::size_t length) {
+        for (std::size_t back = 1; back <= 3 && back <= length; ++back) {
+            if (keys[length - back] == '\x1b') {
+                return back == 1 || (keys[length - back + 1] == '[' &&
+                                     (back == 2 || (keys[length - 1] >= '0' && keys[length - 1] <= '9')));
+            }
+        }
+        return false;
+    }
+
+    bool fail() {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+
+    int fd{-1};
+    termios saved{};
+    struct sigaction savedResize{};
+};
+
+/*
+ * Run the picker over a table.
+ * - renderRow: Called as renderRow(OutputBuffer&, position) to append the text of the interface at that position,
+ *   only for the rows on screen; it is cut to the width of the terminal.
+ * - selected: Position chosen by the user, or NO_INTERFACE if they cancelled.
+ * Returns false if there is no terminal to run on.
+ */
+template <typename RenderRow>
+inline bool runPicker(const InterfaceTable& interfaceList, RenderRow&& renderRow, std::size_t& selected) {
+    Terminal terminal;
+    if (!terminal.open()) {
+        return false;
+    }
+    NameIndex index{interfaceList};
+    std::size_t cursor{0}; // In the results
+    std::size_t top{0};    // First result on screen
+    OutputBuffer frame;
+    OutputBuffer row;
+    selected = NO_INTERFACE;
+
+    while (true) {
+        // Draw the search line, a status line and the visible window of the results
+        const std::vector<std::uint32_t>& results{index.results()};
+        std::size_t rows;
+        std::size_t columns;
+        terminal.size(rows, columns);
+        terminalResized() = 0;
+        std::size_t visible{rows > 2 ? rows - 2 : 1};
+        cursor = results.empty() ? 0 : std::min(cursor, results.size() - 1);
+        if (cursor < top) {
+            top = cursor;
+        } else if (cursor >= top + visible) {
+            top = cursor - visible + 1;
+        }
+
+        frame.clear();
+        frame += "\x1b[H> ";
+        frame += index.query();
+        frame += "\x1b[K\r\n\x1b[2m  ";
+        frame += std::to_string(results.size());
+        frame += '/';
+        frame += std::to_string(interfaceList.size());
+        frame += " interfaces\x1b[0m\x1b[K";
+        for (std::size_t line = 0; line < visible && top + line < results.size(); ++line) {
+            row.clear();
+            renderRow(row, results[top + line]);
+            if (row.size() + 2 > columns) {
+                row.resize(columns > 2 ? columns - 2 : 0);
+            }
+            bool current{top + line == cursor};
+            frame += current ? "\r\n\x1b[7m> " : "\r\n  ";
+            frame += row;
+            frame += current ? "\x1b[K\x1b[0m" : "\x1b[K";
+        }
+        frame += "\x1b[J\x1b[1;";
+        frame += std::to_string(3 + index.query().size());
+        frame += 'H';
+        if (!terminal.writeAll(frame)) {
+            return true;
+        }
+
+        // Handle every key read at once before drawing again
+        char keys[64];
+        ssize_t length{terminal.read(keys, sizeof(keys))};
+        if (length < 0) {
+            return true;
+        }
+        auto moveDown{[&](std::size_t rowsDown) {
+            std::size_t count{index.results().size()};
+            cursor = count == 0 ? 0 : std::min(cursor + rowsDown, count - 1);
+        }};
+        for (ssize_t i = 0; i < length; ++i) {
+            char key{keys[i]};
+            if (key == '\x1b' && i + 2 < length && keys[i + 1] == '[') {
+                char code{keys[i + 2]};
+                i += 2;
+                if ((code == '5' || code == '6') && i + 1 < length && keys[i + 1] == '~') {
+                    ++i;
+                    if (code == '5') {
+                        cursor = cursor > visible ? cursor - visible : 0;
+                    } else {
+                        moveDown(visible);
+                    }
+                } else if (code == 'A') {
+                    cursor = cursor > 0 ? cursor - 1 : 0;
+                } else if (code == 'B') {
+                    moveDown(1);
+                }
+            } else if (key == '\x1b' || key == 3 || (key == 4 && index.query().empty())) {
+                return true;
+            } else if (key == '\r' || key == '\n') {
+                // Keys before it in the same read may have changed the results
+                const std::vector<std::uint32_t>& current{index.results()};
+                if (!current.empty()) {
+                    selected = current[std::min(cursor, current.size() - 1)];
+                    return true;
+                }
+            } else if (key == 16) {
+                cursor = cursor > 0 ? cursor - 1 : 0;
+            } else if (key == 14) {
+                moveDown(1);
+            } else if (key == 127 || key == 8) {
+                index.pop();
+            } else if (key == 21) {
+                index.clear();
+            } else if (key >= 0x20 && key < 0x7f) {
+                index.push(key);
+                cursor = 0;
+                top = 0;
+            }
+        }
+    }
+}
+
+#endif // IFACEPICKER_TUI_HPP
@@ -0,0 +1,210 @@
+/*
+ * watch.hpp - `ifacepicker --watch`: stream interface and address changes as they happen.
+ *
+ * The current interfaces are printed once, then only the differences, as rtnetlink notifications arrive:
+ *   +IFACE=eth0 IPADDR=192.0.2.2    eth0 is shown with this address (one line per address)
+ *   +IFACE=eth1                     eth1 is shown and has no address
+ *   -IFACE=eth0 IPADDR=192.0.2.2    This address was removed from eth0
+ *   -IFACE=eth1                     eth1 is gone (removed, renamed, or no longer matching the filters)
+ * The filters and the --iface/--match selectors restrict what is shown. Each notification only causes the affected
+ * interface to be compared with what was last printed for it.
+ */
+
+#ifndef IFACEPICKER_WATCH_HPP
+#define IFACEPICKER_WATCH_HPP
+
+#include <fnmatch.h>
+#include <poll.h>
+#include <signal.h>
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "console.hpp"
+#include "filter.hpp"
+#include "interface_table.hpp"
+#include "live_state.hpp"
+#include "output.hpp"
+#include "selector.hpp"
+
+class InterfaceWatcher : public LiveStateObserver {
+public:
+    InterfaceWatcher(const InterfaceFilter& interfaceFilter, const InterfaceSelector& interfaceSelector)
+        : filter{interfaceFilter}, selector{interfaceSelector} {}
+
+    int run() {
+        if (!monitor.start()) {
+            return 1;
+        }
+        monitor.state().setObserver(this);
+
+        struct sigaction action{};
+        action.sa_handler = [](int) { watchStopRequested() = 1; };
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        // Initial snapshot: everything is new
+        refreshAll();
+        flush();
+
+        while (!watchStopRequested()) {
+            pollfd descriptor{monitor.descriptor(), POLLIN, 0};
+            if (poll(&descriptor, 1, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                errorMessage() << "Error waiting for events: " << std::strerror(errno) << '\n';
+                return 1;
+            }
+
+            if (monitor.applyNotifications()) {
+                for (int index : pending) {
+                    refresh(index);
+                }
+            } else {
+                // Notifications were lost and the state was dumped again: compare everything
+                refreshAll();
+            }
+            pending.clear();
+            flush();
+        }
+        return 0;
+    }
+
+    // Changes are only recorded here; they are compared once the whole batch has been applied
+    void linkChanged(int index, const LiveLink*, const LiveLink*) override { pending.push_back(index); }
+    void addressChanged(int index, const LiveLink&, const AddressRecord&, bool) override { pending.push_back(index); }
+
+private:
+    // What was last printed for an interface
+    struct ShownLink {
+        std::string name;
+        std::vector<AddressRecord> addresses;
+    };
+
+    static volatile std::sig_atomic_t& watchStopRequested() {
+        static volatile std::sig_atomic_t stop{0};
+        return stop;
+    }
+
+    bool visible(const LiveLink& link) const {
+        if (!filter.acceptsFlags(link.flags) || !filter.acceptsLinkType(link.kind, link.hardwareType)) {
+            return false;
+        }
+        if (selector.kind == InterfaceSelector::Kind::Name) {
+            return selector.value == link.name;
+        }
+        if (selector.kind == InterfaceSelector::Kind::Match) {
+            return fnmatch(selector.value.c_str(), link.name, 0) == 0;
+        }
+        return true;
+    }
+
+    void printLine(char sign, const std::string& name, const AddressRecord* entry) {
+        out += sign;
+        out += "IFACE=";
+        out += name;
+        if (entry != nullptr) {
+            char text[ADDRESS_TEXT_SIZE];
+            out += " IPADDR=";
+            out += formatAddress(*entry, text);
+        }
+        out += '\n';
+    }
+
+    static bool contains(const std::vector<AddressRecord>& addresses, const AddressRecord& entry) {
+        for (const AddressRecord& candidate : addresses) {
+            if (sameAddress(candidate, entry)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Compare one interface with what was last printed for it and print the difference
+    void refresh(int index) {
+        const auto& links{monitor.state().linkMap()};
+        auto current{links.find(index)};
+        bool isVisible{current != links.end() && visible(current->second)};
+
+        auto old{shown.find(index)};
+        if (old != shown.end() && (!isVisible || old->second.name != current->second.name)) {
+            printLine('-', old->second.name, nullptr);
+            shown.erase(old);
+            old = shown.end();
+        }
+        if (!isVisible) {
+            return;
+        }
+
+        std::vector<AddressRecord> addresses;
+        for (const AddressRecord& entry : current->second.addresses) {
+            if (filter.acceptsFamily(entry.family)) {
+                addresses.push_back(entry);
+            }
+        }
+
+        if (old == shown.end()) {
+            ShownLink& link{shown[index]};
+            link.name = current->second.name;
+            for (const AddressRecord& entry : addresses) {
+                printLine('+', link.name, &entry);
+            }
+            if (addresses.empty()) {
+                printLine('+', link.name, nullptr);
+            }
+            link.addresses.swap(addresses);
+            return;
+        }
+
+        for (const AddressRecord& entry : old->second.addresses) {
+            if (!contains(addresses, entry)) {
+                printLine('-', old->second.name, &entry);
+            }
+        }
+        for (const AddressRecord& entry : addresses) {
+            if (!contains(old->second.addresses, entry)) {
+                printLine('+', old->second.name, &entry);
+            }
+        }
+        old->second.addresses.swap(addresses);
+    }
+
+    void refreshAll() {
+        std::vector<int> indexes;
+        for (const auto& entry : shown) {
+            indexes.push_back(entry.first);
+        }
+        for (const auto& entry : monitor.state().linkMap()) {
+            indexes.push_back(entry.first);
+        }
+        for (int index : indexes) {
+            refresh(index);
+        }
+    }
+
+    void flush() {
+        if (!out.empty()) {
+            writeOutput(STDOUT_FILENO, out);
+            out.clear();
+        }
+    }
+
+    const InterfaceFilter& filter;
+    const InterfaceSelector& selector;
+    InterfaceMonitor monitor;
+    std::map<int, ShownLink> shown;
+    std::vector<int> pending; // Interfaces changed by the current batch of notifications
+    OutputBuffer out;         // Output of the current batch, written at once
+};
+
+// Function to run `ifacepicker --watch` until interrupted; returns the exit status
+inline int runWatch(const InterfaceFilter& filter, const InterfaceSelector& selector) {
+    InterfaceWatcher watcher{filter, selector};
+    return watcher.run();
+}
+
+#endif // IFACEPICKER_WATCH_HPP